@@ -0,0 +1,83 @@
+// Thread scaling of the storage. Writers put disjoint key ranges, which land in the memtable,
+// the tree is changed only by the flush thread. Readers look up keys, while a writer keeps
+// changing the table. The same records are split between threads, as the table size is limited.
+// Usage: AnilopBench [records] [max threads]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "storage/storage.h"
+
+namespace {
+
+const std::string kPath = "bench.db";
+
+void RemoveTable() {
+    for (const auto& file : std::filesystem::directory_iterator(".")) {
+        if (file.path().filename().string().starts_with(kPath)) {
+            std::filesystem::remove(file.path());
+        }
+    }
+}
+
+std::vector<byte> Key(size_t thread, size_t index) {
+    auto key = "key" + std::to_string(thread) + "_" + std::to_string(index);
+    return {key.begin(), key.end()};
+}
+
+/// @return Operations per second of threads, that do records operations together
+template <class Operation>
+double Measure(size_t threads, size_t records, const Operation& operation) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&operation, t, records = records / threads]() {
+            for (size_t i = 0; i < records; ++i) {
+                operation(t, i);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return records / threads * threads / elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t records = argc > 1 ? std::stoul(argv[1]) : 2048;
+    size_t max_threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+    settings::UserSettings settings;
+    std::vector<byte> value(100, 'v');
+
+    std::printf("%8s %16s %16s\n", "threads", "puts/s", "finds/s");
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        RemoveTable();
+        double puts;
+        double finds;
+        {
+            Storage storage(kPath, settings);
+            puts = Measure(threads, records, [&](size_t t, size_t i) { storage.Put(Key(t, i), value); });
+
+            // Readers share the table with a writer, that keeps the flush thread busy by overwrites
+            std::atomic<bool> stop = false;
+            std::thread writer([&]() {
+                for (size_t i = 0; !stop; ++i) {
+                    storage.Put(Key(0, i % (records / threads)), value);
+                }
+            });
+            finds = Measure(threads, records, [&](size_t t, size_t i) { storage.Find(Key(t, i)); });
+            stop = true;
+            writer.join();
+        }
+        std::printf("%8zu %16.0f %16.0f\n", threads, puts, finds);
+    }
+    RemoveTable();
+    return 0;
+}
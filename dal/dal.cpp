@@ -1,10 +1,19 @@
 #include "dal.h"
 
+#include <cerrno>
 #include <memory>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file.h"
+
 DAL::DAL(const std::string& path,
-         const settings::UserSettings&) :
+         const settings::UserSettings& user_settings) :
+      path_(path),
       file_(),
+      // Shadow pages are published by the meta write, so they are never buffered
+      write_back_(!user_settings.copy_on_write),
       meta_(new Meta()),
       free_list_(new FreeList(settings::kMaxPage)) {
     // Check file existence and read metadata if needed
@@ -14,14 +23,26 @@ DAL::DAL(const std::string& path,
     } else {
         file_.open(path,  std::fstream::in | std::fstream::out | std::fstream::trunc);
     }
+    read_fd_ = ::open(path.c_str(), O_RDONLY);
+    if (read_fd_ < 0) {
+        throw dal_error::FileError("File open failed.");
+    }
 
     if (file_exist) {
         readMeta();
         readFreeList();
     } else {
-        // Gets a page for free_list_ and updates metadata
+        // Gets a page for free_list_ and updates metadata. Fresh file is written at once,
+        // so checkpoints always find valid meta and freelist in it
         meta_->SetFreeListPage(free_list_->GetNextPage());
-        writeMeta();
+        auto page = AllocateEmptyPage();
+        meta_->Serialize(page->Data(), settings::kPageSize);
+        page->SetPageNum(meta_page_num_);
+        writePageToFile(*page);
+        page = GetFreeListPage();
+        writePageToFile(*page);
+        file_.flush();
+        updateCanWrite();
     }
 }
 
@@ -34,46 +55,153 @@ std::shared_ptr<Page> DAL::AllocateEmptyPage() {
 }
 
 std::shared_ptr<Page> DAL::ReadPage(uint64_t page_num) {
-    std::unique_lock lock(mutex_);
-    if (!file_.is_open())
+    std::shared_lock lock(buffer_mutex_);
+    if (read_fd_ < 0)
+        throw dal_error::FileError("File is closed");
+
+    if (auto it = dirty_pages_.find(page_num); it != dirty_pages_.end()) {
+        return std::make_shared<Page>(*it->second);
+    }
+    return readPageFromFile(page_num);
+}
+
+std::shared_ptr<Page> DAL::ReadStoredPage(uint64_t page_num) {
+    std::shared_lock lock(buffer_mutex_);
+    if (read_fd_ < 0)
         throw dal_error::FileError("File is closed");
 
+    auto page = readPageFromFile(page_num);
+    page->SetPageNum(page_num);
+    return page;
+}
+
+std::shared_ptr<Page> DAL::readPageFromFile(uint64_t page_num) {
     std::shared_ptr<Page> page = AllocateEmptyPage();
     // Page offset in file
     uint64_t offset = page_num * settings::kPageSize;
-    // Retrieve page from file
-    file_.seekg(offset);
-    if (file_.fail()) {
-        throw dal_error::FileError("File is corrupted.");
-    }
-    file_.readsome(page->Data(), settings::kPageSize);
-    if (file_.fail()) {
-        throw dal_error::FileError("File read failed.");
+    // Pages past the end of file are read as zeros
+    size_t done = 0;
+    while (done < settings::kPageSize) {
+        auto result = ::pread(read_fd_, page->Data() + done, settings::kPageSize - done,
+                              static_cast<off_t>(offset + done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw dal_error::FileError("File read failed.");
+        }
+        if (result == 0) {
+            break;
+        }
+        done += result;
     }
+    read_count_.fetch_add(1, std::memory_order_relaxed);
 
     return page;
 }
 
+uint64_t DAL::GetReadCount() const {
+    return read_count_.load(std::memory_order_relaxed);
+}
+
 void DAL::WritePage(const std::shared_ptr<Page>& page) {
     std::unique_lock lock(mutex_);
     if (!file_.is_open())
         throw dal_error::FileError("File is closed");
 
-    uint64_t offset = page->GetPageNum() * settings::kPageSize;
+    if (write_back_) {
+        auto copy = std::make_shared<Page>(*page);
+        std::unique_lock buffer_lock(buffer_mutex_);
+        dirty_pages_[page->GetPageNum()] = std::move(copy);
+        return;
+    }
+    writePageToFile(*page);
+    // Flush is important to keep data up to date
+    file_.flush();
+    if (file_.fail()) {
+        throw dal_error::FileError("File flush failed.");
+    }
+}
+
+void DAL::writePageToFile(const Page& page) {
+    uint64_t offset = page.GetPageNum() * settings::kPageSize;
     // Write page into file
     file_.seekp(offset);
     if (file_.fail()) {
         throw dal_error::FileError("File is corrupted.");
     }
-    file_.write(page->Data(), settings::kPageSize);
+    file_.write(page.Data(), settings::kPageSize);
     if (file_.fail()) {
         throw dal_error::FileError("File write failed.");
     }
-    // Flush is important to keep data up to date
+}
+
+void DAL::WritePageRange(uint64_t page_num, size_t offset, const byte* data, size_t size) {
+    std::unique_lock lock(mutex_);
+    if (!file_.is_open())
+        throw dal_error::FileError("File is closed");
+
+    file_.seekp(page_num * settings::kPageSize + offset);
+    if (file_.fail()) {
+        throw dal_error::FileError("File is corrupted.");
+    }
+    file_.write(data, size);
+    if (file_.fail()) {
+        throw dal_error::FileError("File write failed.");
+    }
+    file_.flush();
+    if (file_.fail()) {
+        throw dal_error::FileError("File flush failed.");
+    }
+}
+
+std::vector<std::shared_ptr<Page>> DAL::GetDirtyPages() {
+    std::shared_lock lock(buffer_mutex_);
+    std::vector<std::shared_ptr<Page>> pages;
+    pages.reserve(dirty_pages_.size());
+    for (const auto& [page_num, page] : dirty_pages_) {
+        pages.push_back(page);
+    }
+    return pages;
+}
+
+size_t DAL::GetDirtyPageCount() {
+    std::shared_lock lock(buffer_mutex_);
+    return dirty_pages_.size();
+}
+
+void DAL::ClearDirtyPages(const std::vector<std::shared_ptr<Page>>& pages) {
+    std::unique_lock lock(buffer_mutex_);
+    // Buffered pages are replaced, not changed, so the same pointer means the same content
+    for (const auto& page : pages) {
+        if (auto it = dirty_pages_.find(page->GetPageNum()); it != dirty_pages_.end() && it->second == page) {
+            dirty_pages_.erase(it);
+        }
+    }
+}
+
+void DAL::Sync() {
+    std::unique_lock lock(mutex_);
+    if (!file_.is_open())
+        throw dal_error::FileError("File is closed");
+
     file_.flush();
     if (file_.fail()) {
         throw dal_error::FileError("File flush failed.");
     }
+    file::SyncFile(path_);
+}
+
+void DAL::Reload() {
+    std::unique_lock lock(mutex_);
+    {
+        std::unique_lock buffer_lock(buffer_mutex_);
+        dirty_pages_.clear();
+    }
+    free_list_deferred_ = false;
+    readMeta();
+    free_list_ = std::make_shared<FreeList>(settings::kMaxPage);
+    readFreeList();
 }
 
 uint64_t DAL::GetNextPage() {
@@ -82,8 +210,11 @@ uint64_t DAL::GetNextPage() {
         throw dal_error::FileError("File is closed");
 
     auto next_page = free_list_->GetNextPage();
+    updateCanWrite();
     // Update freelist status
-    writeFreeList();
+    if (!free_list_deferred_) {
+        writeFreeList();
+    }
     return next_page;
 }
 
@@ -93,8 +224,23 @@ void DAL::ReleasePage(uint64_t page_num) {
         throw dal_error::FileError("File is closed");
 
     free_list_->ReleasePage(page_num);
+    updateCanWrite();
     // Update freelist status
-    writeFreeList();
+    if (!free_list_deferred_) {
+        writeFreeList();
+    }
+}
+
+void DAL::DeferFreeList(bool defer) {
+    std::unique_lock lock(mutex_);
+    free_list_deferred_ = defer;
+}
+
+void DAL::ReloadFreeList() {
+    std::unique_lock lock(mutex_);
+    free_list_deferred_ = false;
+    free_list_ = std::make_shared<FreeList>(settings::kMaxPage);
+    readFreeList();
 }
 
 void DAL::Close() {
@@ -102,8 +248,17 @@ void DAL::Close() {
     if (!file_.is_open())
         throw dal_error::FileError("File is closed");
 
-    writeMeta();
+    can_write_ = false;
+    WriteMeta();
     writeFreeList();
+    // Owner checkpoints before close, so only meta and freelist may be left buffered
+    std::unique_lock buffer_lock(buffer_mutex_);
+    for (const auto& [page_num, page] : dirty_pages_) {
+        writePageToFile(*page);
+    }
+    dirty_pages_.clear();
+    ::close(read_fd_);
+    read_fd_ = -1;
 
     file_.close();
     if (file_.fail()) {
@@ -118,7 +273,8 @@ DAL::~DAL() {
     }
 }
 
-void DAL::writeMeta() {
+void DAL::WriteMeta() {
+    std::unique_lock lock(mutex_);
     std::shared_ptr<Page> page = AllocateEmptyPage();
     page->SetPageNum(meta_page_num_);
     
@@ -142,11 +298,15 @@ void DAL::writeFreeList() {
 void DAL::readFreeList() {
     std::shared_ptr<Page> page = ReadPage(meta_->GetFreeListPage());
     free_list_->Deserialize(page->Data(), settings::kPageSize);
+    updateCanWrite();
 }
 
-bool DAL::CanWrite() {
-    std::unique_lock lock(mutex_);
-    return file_.is_open() && free_list_->HasFreePages();
+void DAL::updateCanWrite() {
+    can_write_.store(free_list_->HasFreePages(), std::memory_order_relaxed);
+}
+
+bool DAL::CanWrite() const {
+    return can_write_.load(std::memory_order_relaxed);
 }
 
 std::shared_ptr<Page> DAL::GetFreeListPage() {
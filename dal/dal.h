@@ -7,6 +7,10 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
 
 #include "log.h"
 #include "page.h"
@@ -17,6 +21,9 @@
 #include "settings/settings.h"
 #include "exception/exception.h"
 
+// Outside of copy-on-write mode written pages are buffered, until the caller writes them back by
+// GetDirtyPages, WritePageRange and Sync at a checkpoint. Reads see buffered pages first.
+// Page reads are positional and take only a shared lock of the buffer, so they run concurrently with writes
 class DAL {
 public:
   DAL(const std::string& path,
@@ -25,33 +32,75 @@ public:
   std::shared_ptr<Meta> GetMetaPtr();
 
   std::shared_ptr<Page> AllocateEmptyPage();
+  /// @brief Reads a copy of page. Thread-safe
   std::shared_ptr<Page> ReadPage(uint64_t page_num);
+  /// @brief Reads page as it's in the file, buffered changes ignored
+  std::shared_ptr<Page> ReadStoredPage(uint64_t page_num);
+  /// @brief Buffers a copy of page or writes it, if buffering is off
   void WritePage(const std::shared_ptr<Page>& page);
+  /// @brief Writes a part of page in place, bypassing the buffer
+  void WritePageRange(uint64_t page_num, size_t offset, const byte* data, size_t size);
+  /// @return Number of pages, read from the file
+  uint64_t GetReadCount() const;
+
+  /// @return Copies of buffered pages, that differ from the file
+  std::vector<std::shared_ptr<Page>> GetDirtyPages();
+  size_t GetDirtyPageCount();
+  /// @brief Drops pages, returned by GetDirtyPages, once they are written back.
+  /// Pages, buffered again since then, are kept
+  void ClearDirtyPages(const std::vector<std::shared_ptr<Page>>& pages);
+  /// @brief Makes written pages durable
+  void Sync();
+  /// @brief Drops buffered pages and reads meta and freelist from the file
+  void Reload();
 
   std::shared_ptr<Page> GetFreeListPage();
 
   uint64_t GetNextPage();
   void ReleasePage(uint64_t page_num);
+  /// @brief Keeps freelist changes in memory, while defer is set, so they can be journaled first.
+  /// Deferred changes are written by the caller, they are not written, when defer is reset
+  void DeferFreeList(bool defer);
+  /// @brief Drops deferred freelist changes and reads the freelist from the file
+  void ReloadFreeList();
 
-  bool CanWrite();
+  /// @brief Whether the file is open and has free pages. Takes no lock, so writers never wait for page I/O
+  bool CanWrite() const;
+
+  /// @brief Writes meta page, making current root visible after reopen
+  void WriteMeta();
 
   void Close();
   ~DAL();
 
 private:
-  void writeMeta();
   void readMeta();
 
   void readFreeList();
   void writeFreeList();
+  /// @brief Updates can_write_ after freelist change. Called under mutex_
+  void updateCanWrite();
+
+  std::shared_ptr<Page> readPageFromFile(uint64_t page_num);
+  void writePageToFile(const Page& page);
 
+  std::string path_;
   std::fstream file_;
+  // Descriptor for page reads. Written pages are flushed before they can be read
+  int read_fd_ = -1;
+  bool write_back_;
+  // Buffered pages are replaced, never changed in place. Guarded by buffer_mutex_
+  std::unordered_map<uint64_t, std::shared_ptr<Page>> dirty_pages_;
+  std::shared_mutex buffer_mutex_;
 
   const uint64_t meta_page_num_ = 0;
   std::shared_ptr<Meta> meta_;
   std::shared_ptr<FreeList> free_list_;
+  bool free_list_deferred_ = false;
+  std::atomic<bool> can_write_ = false;
 
   std::recursive_mutex mutex_;
+  std::atomic<uint64_t> read_count_ = 0;
 };
 
 #endif  // DAL_H_
@@ -0,0 +1,90 @@
+#include "file.h"
+
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace file {
+
+std::vector<byte> ReadFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw dal_error::FileError("File open failed.");
+    }
+    std::vector<byte> data(std::filesystem::file_size(path));
+    size_t done = 0;
+    while (done < data.size()) {
+        auto result = ::pread(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            ::close(fd);
+            throw dal_error::FileError("File read failed.");
+        }
+        done += result;
+    }
+    ::close(fd);
+    return data;
+}
+
+void WriteFileAtomic(const std::string& path, const std::vector<byte>& data) {
+    auto temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw dal_error::FileError("File open failed.");
+    }
+    size_t done = 0;
+    while (done < data.size()) {
+        auto result = ::write(fd, data.data() + done, data.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            ::close(fd);
+            throw dal_error::FileError("File write failed.");
+        }
+        done += result;
+    }
+    int result = ::fdatasync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw dal_error::FileError("File sync failed.");
+    }
+    std::filesystem::rename(temp_path, path);
+    SyncDirectory(path);
+}
+
+void RemoveFile(const std::string& path) {
+    if (std::filesystem::remove(path)) {
+        SyncDirectory(path);
+    }
+}
+
+void SyncFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw dal_error::FileError("File open failed.");
+    }
+    int result = ::fdatasync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw dal_error::FileError("File sync failed.");
+    }
+}
+
+void SyncDirectory(const std::string& path) {
+    auto directory = std::filesystem::absolute(path).parent_path();
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw dal_error::FileError("Directory open failed.");
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw dal_error::FileError("Directory sync failed.");
+    }
+}
+
+}  // namespace file
@@ -0,0 +1,26 @@
+#ifndef FILE_H_
+#define FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "memory/type.h"
+#include "exception/exception.h"
+
+namespace file {
+
+/// @brief Reads the whole file
+std::vector<byte> ReadFile(const std::string& path);
+/// @brief Replaces file with data, so a crash leaves either the old or the new content.
+/// Data is written to a temporary file, synced and renamed over the file
+void WriteFileAtomic(const std::string& path, const std::vector<byte>& data);
+/// @brief Removes file and makes the removal durable
+void RemoveFile(const std::string& path);
+/// @brief Makes written data of the file durable
+void SyncFile(const std::string& path);
+/// @brief Syncs the directory of path, so created, renamed and removed files in it are durable
+void SyncDirectory(const std::string& path);
+
+}  // namespace file
+
+#endif  // FILE_H_
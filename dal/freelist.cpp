@@ -1,5 +1,6 @@
 #include "freelist.h"
 
+#include <algorithm>
 #include <numeric>
 
 FreeList::FreeList() : FreeList(0) {}
@@ -50,6 +51,7 @@ size_t FreeList::Deserialize(const byte* data, size_t max_volume) {
         released_pages_.resize(released_pages_size);
         for (size_t i = 0; i < released_pages_size; ++i) {
             released_pages_[i] = memory::bytes_to_uint64(data);
+            data += uint64_t_size;
         }
     }
     return r_size + released_pages_size * uint64_t_size;
@@ -83,3 +85,8 @@ void FreeList::ReleaseAllPages(uint64_t start_page_num) {
 bool FreeList::HasFreePages() {
     return current_max_page_ < max_page_ || !released_pages_.empty();
 }
+
+bool FreeList::IsFree(uint64_t page_num) const {
+    return page_num > current_max_page_
+        || std::find(released_pages_.begin(), released_pages_.end(), page_num) != released_pages_.end();
+}
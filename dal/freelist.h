@@ -23,6 +23,8 @@ class FreeList : public ISerializable {
     void ReleaseAllPages(uint64_t start_page_num);
 
     bool HasFreePages();
+    /// @return Whether page is not allocated
+    bool IsFree(uint64_t page_num) const;
 
    private:
     uint64_t max_page_;
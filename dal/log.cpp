@@ -20,21 +20,25 @@ Log::Log(Log::Command command) : command_(command) {
 }
 
 size_t Log::Serialize(byte *data, size_t max_volume) const {
-    size_t o_size = 1 + 2 * uint64_t_size + key_.size() + value_.size();
+    return Serialize(AsView(), data, max_volume);
+}
+
+size_t Log::Serialize(const View& view, byte* data, size_t max_volume) {
+    size_t o_size = GetByteLength(view);
     if (max_volume < o_size) {
         throw dal_error::InsufficientBufferSize("Max volume is too low for serialisation.");
     }
 
-    *data = static_cast<byte>(command_);
+    *data = static_cast<byte>(view.command);
     data += 1;
-    memory::uint64_to_bytes(data, key_.size());
+    memory::uint64_to_bytes(data, view.key.size());
     data += uint64_t_size;
-    memory::uint64_to_bytes(data, value_.size());
+    memory::uint64_to_bytes(data, view.value.size());
     data += uint64_t_size;
 
-    std::memcpy(data, key_.data(), key_.size());
-    data += key_.size();
-    std::memcpy(data, value_.data(), value_.size());
+    std::memcpy(data, view.key.data(), view.key.size());
+    data += view.key.size();
+    std::memcpy(data, view.value.data(), view.value.size());
 
     return o_size;
 }
@@ -67,6 +71,20 @@ size_t Log::Deserialize(const byte *data, size_t max_volume) {
     return r_size + key_size + value_size;
 }
 
+Log::View Log::ReadView(const byte* buffer, size_t max_size) {
+    size_t r_size = 1 + 2 * uint64_t_size;
+    if (max_size < r_size) {
+        throw dal_error::CorruptedBuffer("Buffer size is too low for deserialization.");
+    }
+    uint64_t key_size = memory::bytes_to_uint64(buffer + 1);
+    uint64_t value_size = memory::bytes_to_uint64(buffer + 1 + uint64_t_size);
+    if (max_size - r_size < key_size || max_size - r_size - key_size < value_size) {
+        throw dal_error::CorruptedBuffer("Buffer size is too low for deserialization.");
+    }
+    const byte* key = buffer + r_size;
+    return {static_cast<Command>(*buffer), {key, key_size}, {key + key_size, value_size}};
+}
+
 Log::Command Log::GetCommand() const {
     return command_;
 }
@@ -91,7 +109,15 @@ size_t Log::GetByteLength() const {
     return 1 + 2 * uint64_t_size + key_.size() + value_.size();
 }
 
-Log Log::readFromBuffer(byte *buffer, size_t max_size) {
+size_t Log::GetByteLength(const View& view) {
+    return 1 + 2 * uint64_t_size + view.key.size() + view.value.size();
+}
+
+Log::View Log::AsView() const {
+    return {command_, {key_.data(), key_.size()}, {value_.data(), value_.size()}};
+}
+
+Log Log::readFromBuffer(const byte *buffer, size_t max_size) {
     Log log;
     log.Deserialize(buffer, max_size);
     return log;
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstring>
+#include <string_view>
 
 #include "dal/serializable.h"
 #include "memory/type.h"
@@ -20,12 +21,26 @@ public:
     Log(Command command, const std::vector<byte>& key);
     Log(Command command);
 
-    static Log readFromBuffer(byte* buffer, size_t max_size);
+    /// @brief Fields of a serialized log, that point into its buffer
+    struct View {
+        Command command;
+        std::string_view key;
+        std::string_view value;
+    };
+
+    static Log readFromBuffer(const byte* buffer, size_t max_size);
+    /// @brief Parses serialized log without copying key and value
+    static View ReadView(const byte* buffer, size_t max_size);
+    /// @brief Serializes log fields straight from the caller buffers
+    static size_t Serialize(const View& view, byte* data, size_t max_volume);
+    static size_t GetByteLength(const View& view);
 
     size_t Serialize(byte* data, size_t max_volume) const override;
     size_t Deserialize(const byte* data, size_t max_volume) override;
 
     size_t GetByteLength() const;
+    /// @return Fields, that point into the log, valid while it's alive
+    View AsView() const;
 
     Command GetCommand() const;
 
@@ -1,8 +1,15 @@
 #include "log_dal.h"
 
-LogDAL::LogDAL(const std::string &path, const settings::UserSettings &)
+#include "memory/memory.h"
+
+LogDAL::LogDAL(const std::string &path, const settings::UserSettings &user_settings)
     : path_(path)
-    , meta_(new LogMeta()) {
+    , meta_(new LogMeta())
+    , segment_size_(user_settings.log_segment_size)
+    , durability_(user_settings.durability)
+    , sync_interval_(user_settings.sync_interval_us) {
+    pending_.reserve(kQueueCapacity);
+    batch_.reserve(kQueueCapacity);
     bool file_exist = std::filesystem::exists(path);
     if (file_exist) {
         file_.open(path,  std::fstream::in | std::fstream::out);
@@ -12,76 +19,340 @@ LogDAL::LogDAL(const std::string &path, const settings::UserSettings &)
 
     if (file_exist) {
         ReadMeta();
+        // Release could be interrupted before all segments were recycled
+        RecycleSegments(meta_->GetFirstSegment());
     } else {
-        meta_->SetDataEndOffset(meta_->GetSize());
+        // Segments left without meta don't belong to the new log
+        auto log_path = std::filesystem::absolute(path);
+        auto prefix = log_path.filename().string() + ".";
+        for (const auto& entry : std::filesystem::directory_iterator(log_path.parent_path())) {
+            auto name = entry.path().filename().string();
+            if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0
+                && name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+                std::filesystem::remove(entry.path());
+            }
+        }
         WriteMeta();
     }
+
+    // Valid tail is found by scanning frames
+    uint64_t next_sequence = meta_->GetStartSequence();
+    CutTail(ScanFrames([&next_sequence](uint64_t sequence, uint32_t count, const byte*, size_t, Position) {
+        next_sequence = sequence + count;
+    }));
+    appended_sequence_ = next_sequence - 1;
+    durable_sequence_ = appended_sequence_;
 }
 
 std::shared_ptr<LogMeta> LogDAL::GetMetaPtr() {
     return meta_;
 }
 
-std::vector<byte> LogDAL::ReadLogBuffer() {
-    std::unique_lock lock(mutex_);
-    if (!file_.is_open())
-        throw dal_error::FileError("File is closed");
+void LogDAL::Replay(const std::function<void(uint64_t, const byte*, size_t)>& visitor) {
+    ScanFrames([&visitor](uint64_t sequence, uint32_t count, const byte* payload, size_t size, Position) {
+        // Records of a batch follow each other and take successive sequences
+        size_t offset = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            auto length = Log::GetByteLength(Log::ReadView(payload + offset, size - offset));
+            visitor(sequence + i, payload + offset, length);
+            offset += length;
+        }
+    });
+}
 
-    file_.seekg(0, file_.end);
-    uint64_t size = file_.tellg();
-    size -= meta_->GetSize();
-    // Put file read position to data
-    file_.seekg(meta_->GetSize(), file_.beg);
-    if (size == 0) {
-        return {};
-    }
-    std::vector<byte> buffer(size);
-    file_.read(buffer.data(), size);
+std::vector<byte> LogDAL::ReadLogBuffer() {
+    std::vector<byte> buffer;
+    Replay([&buffer](uint64_t, const byte* payload, size_t size) {
+        buffer.insert(buffer.end(), payload, payload + size);
+    });
     return buffer;
 }
 
 void LogDAL::WriteLog(const Log &log) {
+    WaitDurable(Append(log));
+}
+
+uint64_t LogDAL::Append(const Log &log) {
+    return Append(log.AsView());
+}
+
+uint64_t LogDAL::Append(const Log::View &log) {
+    auto size = Log::GetByteLength(log);
+    std::unique_lock lock(queue_mutex_);
+    auto offset = pending_.size();
+    auto sequence = QueueFrame(size, 1);
+    Log::Serialize(log, pending_.data() + offset + kFrameHeaderSize, size);
+    SealFrame(offset);
+    return sequence;
+}
+
+uint64_t LogDAL::AppendBatch(const std::vector<Log> &logs) {
+    size_t size = 0;
+    for (const auto& log : logs) {
+        size += log.GetByteLength();
+    }
+    std::unique_lock lock(queue_mutex_);
+    auto offset = pending_.size();
+    auto sequence = QueueFrame(size, logs.size());
+    byte* payload = pending_.data() + offset + kFrameHeaderSize;
+    for (const auto& log : logs) {
+        payload += log.Serialize(payload, log.GetByteLength());
+    }
+    SealFrame(offset);
+    return sequence + logs.size() - 1;
+}
+
+uint64_t LogDAL::QueueFrame(size_t size, uint32_t count) {
+    // Sequence after a lost batch would never be reached by recovery scan
+    if (failure_) {
+        std::rethrow_exception(failure_);
+    }
+    auto sequence = appended_sequence_ + 1;
+    appended_sequence_ += count;
+    auto offset = pending_.size();
+    pending_.resize(offset + kFrameHeaderSize + size);
+
+    byte* frame = pending_.data() + offset;
+    memory::uint32_to_bytes(frame + 4, size);
+    memory::uint64_to_bytes(frame + 8, sequence);
+    memory::uint32_to_bytes(frame + 16, count);
+    return sequence;
+}
+
+void LogDAL::SealFrame(size_t offset) {
+    // Checksum is salted by the segment, when batch is written
+    byte* frame = pending_.data() + offset;
+    auto size = memory::bytes_to_uint32(frame + 4);
+    memory::uint32_to_bytes(frame, memory::crc32(frame + 4, kFrameHeaderSize - 4 + size));
+}
+
+uint64_t LogDAL::GetLastSequence() {
+    std::unique_lock lock(queue_mutex_);
+    return appended_sequence_;
+}
+
+void LogDAL::WaitDurable(uint64_t sequence) {
+    WaitDurable(sequence, durability_);
+}
+
+void LogDAL::WaitDurable(uint64_t sequence, settings::Durability durability) {
+    std::unique_lock lock(queue_mutex_);
+    if (durability != settings::Durability::kSync) {
+        if (failure_) {
+            std::rethrow_exception(failure_);
+        }
+        StartSyncer();
+        if (durability == settings::Durability::kAsync) {
+            return;
+        }
+        durable_cv_.wait(lock, [this, sequence]() { return durable_sequence_ >= sequence || failure_; });
+        if (durable_sequence_ < sequence) {
+            std::rethrow_exception(failure_);
+        }
+        return;
+    }
+    while (durable_sequence_ < sequence) {
+        // Logs after a failed batch are never written, as their frames would follow a gap in sequence
+        if (failure_) {
+            std::rethrow_exception(failure_);
+        }
+        if (leader_active_) {
+            durable_cv_.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        Lead(false, nullptr);
+        lock.lock();
+    }
+}
+
+void LogDAL::StartSyncer() {
+    if (!syncer_.joinable() && !syncer_stopped_) {
+        syncer_ = std::thread(&LogDAL::SyncLoop, this);
+    }
+}
+
+void LogDAL::StopSyncer() {
+    {
+        std::unique_lock lock(queue_mutex_);
+        syncer_stopped_ = true;
+    }
+    syncer_cv_.notify_all();
+    if (syncer_.joinable()) {
+        syncer_.join();
+    }
+}
+
+void LogDAL::SyncLoop() {
+    std::unique_lock lock(queue_mutex_);
+    while (!failure_) {
+        if (syncer_cv_.wait_for(lock, sync_interval_, [this]() { return syncer_stopped_; })) {
+            return;
+        }
+        if (durable_sequence_ >= appended_sequence_) {
+            continue;
+        }
+        lock.unlock();
+        try {
+            Lead(false, nullptr);
+        } catch (...) {
+            // Error is kept in failure_ and is thrown to the waiters
+        }
+        lock.lock();
+    }
+}
+
+void LogDAL::Lead(bool drop, const std::function<void(uint64_t)>& action) {
+    std::unique_lock lock(queue_mutex_);
+    durable_cv_.wait(lock, [this]() { return !leader_active_; });
+    if (failure_) {
+        std::rethrow_exception(failure_);
+    }
+    // Become a leader: take everything queued so far, including logs of waiting followers
+    leader_active_ = true;
+    // Buffer of the previous batch takes the next logs, so queue capacity is reused
+    batch_.clear();
+    batch_.swap(pending_);
+    auto batch_sequence = appended_sequence_;
+    if (drop) {
+        durable_sequence_ = batch_sequence;
+    }
+    lock.unlock();
+
+    bool written = drop;
+    std::exception_ptr failure;
+    try {
+        if (!drop) {
+            WriteBatch(batch_);
+            written = true;
+        }
+        if (action) {
+            action(batch_sequence);
+        }
+    } catch (...) {
+        failure = std::current_exception();
+    }
+
+    lock.lock();
+    leader_active_ = false;
+    if (written) {
+        durable_sequence_ = std::max(durable_sequence_, batch_sequence);
+    } else {
+        failure_ = failure;
+    }
+    durable_cv_.notify_all();
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void LogDAL::WriteBatch(std::vector<byte>& batch) {
     std::unique_lock lock(mutex_);
     if (!file_.is_open())
         throw dal_error::FileError("File is closed");
 
-    std::vector<byte> data(log.GetByteLength());
-    log.Serialize(data.data(), data.size());
+    // Batch is acknowledged only after all of its segments are synced
+    std::vector<int> written_fds;
+    size_t position = 0;
+    while (position < batch.size()) {
+        // Frames never cross segments. Frame, that is larger than a segment, takes a whole segment
+        uint64_t offset = std::max<uint64_t>(segment_offset_, kSegmentHeaderSize);
+        size_t end = position;
+        while (end < batch.size()) {
+            size_t frame_size = kFrameHeaderSize + memory::bytes_to_uint32(batch.data() + end + 4);
+            bool empty_segment = offset == kSegmentHeaderSize && end == position;
+            if (offset + (end - position) + frame_size > segment_size_ && !empty_segment) {
+                break;
+            }
+            end += frame_size;
+        }
+        if (end == position) {
+            ++segment_index_;
+            segment_offset_ = 0;
+            continue;
+        }
 
-    file_.seekp(meta_->GetDataEndOffset(), file_.beg);
-    file_.write(data.data(), data.size());
-    if (file_.fail()) {
-        throw dal_error::FileError("Log file write failed.");
+        int fd = OpenSegment(segment_index_, true);
+        byte header[kSegmentHeaderSize];
+        if (segment_offset_ == 0) {
+            segment_salt_ = std::random_device()();
+            memory::uint64_to_bytes(header, memory::bytes_to_uint64(batch.data() + position + 8));
+            memory::uint32_to_bytes(header + 8, segment_salt_);
+            memory::uint32_to_bytes(header + 12, memory::crc32(header, 12));
+        }
+        for (size_t frame = position; frame < end;
+             frame += kFrameHeaderSize + memory::bytes_to_uint32(batch.data() + frame + 4)) {
+            auto crc = memory::bytes_to_uint32(batch.data() + frame);
+            memory::uint32_to_bytes(batch.data() + frame, crc ^ segment_salt_);
+        }
+
+        // Header of a recycled segment goes with its first frames in one vectored write
+        iovec parts[2];
+        int parts_count = 0;
+        if (segment_offset_ == 0) {
+            parts[parts_count++] = {header, kSegmentHeaderSize};
+        }
+        parts[parts_count++] = {batch.data() + position, end - position};
+        WriteFully(fd, parts, parts_count, segment_offset_);
+        written_fds.push_back(fd);
+
+        segment_offset_ = offset + (end - position);
+        position = end;
     }
-    // Flush is important to keep data up to date
-    file_.flush();
-    if (file_.fail()) {
-        throw dal_error::FileError("Log file flush failed.");
+
+    for (int fd : written_fds) {
+        Sync(fd);
     }
+}
 
-    // Update offset
-    meta_->SetDataEndOffset(meta_->GetDataEndOffset() + log.GetByteLength());
-    WriteMeta();
+LogDAL::Checkpoint LogDAL::Rotate() {
+    Checkpoint checkpoint{};
+    // Logs, appended after the queue is taken, go to the fresh segment
+    Lead(false, [this, &checkpoint](uint64_t last_sequence) {
+        checkpoint = NextSegment(last_sequence);
+    });
+    return checkpoint;
 }
 
-void LogDAL::ClearLogs() {
+void LogDAL::Release(const Checkpoint& checkpoint) {
     std::unique_lock lock(mutex_);
     if (!file_.is_open())
         throw dal_error::FileError("File is closed");
 
-    // Open close to clear logs
-    file_.close();
-    file_.open(path_,  std::fstream::in | std::fstream::out | std::fstream::trunc);
-
-    meta_->SetDataEndOffset(meta_->GetSize());
+    // Meta is switched first, so the released segments are never scanned again
+    meta_->SetStartSequence(checkpoint.sequence);
+    meta_->SetFirstSegment(checkpoint.segment);
     WriteMeta();
+    RecycleSegments(checkpoint.segment);
+}
+
+void LogDAL::ClearLogs() {
+    // Queued logs are already applied by the caller, so they are dropped and their waiters released.
+    // Leader slot is held during truncation, so no batch is written to the released segments
+    Lead(true, [this](uint64_t last_sequence) {
+        Release(NextSegment(last_sequence));
+    });
 }
 
 void LogDAL::Close() {
+    // Syncer may wait for mutex_, so it's stopped first
+    StopSyncer();
+    std::unique_lock queue_lock(queue_mutex_);
+    bool unsynced = durable_sequence_ < appended_sequence_ && !failure_;
+    queue_lock.unlock();
+    if (unsynced) {
+        Lead(false, nullptr);
+    }
+
     std::unique_lock lock(mutex_);
     if (!file_.is_open())
         throw dal_error::FileError("File is already closed");
 
+    for (const auto& segment : segment_fds_) {
+        ::close(segment.second);
+    }
+    segment_fds_.clear();
+
     file_.close();
     if (file_.fail()) {
         throw dal_error::FileError("File Close failed.");
@@ -89,6 +360,7 @@ void LogDAL::Close() {
 }
 
 LogDAL::~LogDAL() {
+    StopSyncer();
     std::unique_lock lock(mutex_);
     if (file_.is_open()) {
         Close();
@@ -110,6 +382,16 @@ void LogDAL::WriteMeta() {
     if (file_.fail()) {
         throw dal_error::FileError("File Flush failed.");
     }
+    // Segments are reused after start sequence is moved, so meta must reach the disk first
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw dal_error::FileError("File open for sync failed.");
+    }
+    int result = ::fdatasync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw dal_error::FileError("File sync failed.");
+    }
 }
 
 void LogDAL::ReadMeta() {
@@ -122,12 +404,209 @@ void LogDAL::ReadMeta() {
     meta_->Deserialize(meta_buffer.data(), meta_->GetSize());
 }
 
-void LogDAL::ClearLatest(uint64_t offset_to_end) {
-    auto max_offset = meta_->GetDataEndOffset() - meta_->GetSize();
-    if (offset_to_end > max_offset) {
-        offset_to_end = max_offset;
+LogDAL::Position LogDAL::ScanFrames(const FrameVisitor& visitor) {
+    std::unique_lock lock(mutex_);
+    if (!file_.is_open())
+        throw dal_error::FileError("File is closed");
+
+    std::vector<byte> buffer;
+    auto sequence = meta_->GetStartSequence();
+    Position end = {meta_->GetFirstSegment(), 0};
+    // Segments are chained by the first sequence in their headers, each one is decoded on its own
+    for (size_t index = meta_->GetFirstSegment();; ++index) {
+        int fd = OpenSegment(index, false);
+        if (fd < 0) {
+            break;
+        }
+        ReadFully(fd, buffer);
+        if (buffer.size() < kSegmentHeaderSize
+            || memory::crc32(buffer.data(), 12) != memory::bytes_to_uint32(buffer.data() + 12)
+            || memory::bytes_to_uint64(buffer.data()) != sequence) {
+            end = {index, 0};
+            break;
+        }
+        uint32_t salt = memory::bytes_to_uint32(buffer.data() + 8);
+
+        size_t offset = kSegmentHeaderSize;
+        // Scan stops on the first torn, corrupted or stale frame, so a batch is never replayed partially
+        while (buffer.size() - offset >= kFrameHeaderSize) {
+            const byte* frame = buffer.data() + offset;
+            uint32_t length = memory::bytes_to_uint32(frame + 4);
+            uint32_t count = memory::bytes_to_uint32(frame + 16);
+            if (buffer.size() - offset - kFrameHeaderSize < length
+                || memory::bytes_to_uint64(frame + 8) != sequence
+                || count == 0
+                || (memory::crc32(frame + 4, kFrameHeaderSize - 4 + length) ^ salt)
+                    != memory::bytes_to_uint32(frame)) {
+                break;
+            }
+            if (visitor) {
+                visitor(sequence, count, frame + kFrameHeaderSize, length, {index, offset});
+            }
+            offset += kFrameHeaderSize + length;
+            sequence += count;
+        }
+        end = {index, offset};
     }
+    return end;
+}
 
-    meta_->SetDataEndOffset(meta_->GetDataEndOffset() - offset_to_end);
-    WriteMeta();
+void LogDAL::CutTail(Position end) {
+    std::unique_lock lock(mutex_);
+    // Bytes after the end may look like valid frames. Writing continues in the next segment with a new salt
+    // and headers of following segments are wiped, so the scan never reaches them
+    byte empty_header[std::max(kSegmentHeaderSize, kFrameHeaderSize)] = {};
+    if (end.offset != 0) {
+        // Records after the end can be valid ones, that are dropped
+        iovec part = {empty_header, kFrameHeaderSize};
+        int fd = OpenSegment(end.segment, true);
+        WriteFully(fd, &part, 1, end.offset);
+        Sync(fd);
+    }
+    segment_index_ = end.offset == 0 ? end.segment : end.segment + 1;
+    segment_offset_ = 0;
+    for (size_t index = segment_index_; ; ++index) {
+        int fd = OpenSegment(index, false);
+        if (fd < 0) {
+            break;
+        }
+        iovec part = {empty_header, kSegmentHeaderSize};
+        WriteFully(fd, &part, 1, 0);
+        Sync(fd);
+    }
+}
+
+LogDAL::Checkpoint LogDAL::NextSegment(uint64_t last_sequence) {
+    std::unique_lock lock(mutex_);
+    if (segment_offset_ != 0) {
+        ++segment_index_;
+        segment_offset_ = 0;
+    }
+    return {last_sequence + 1, segment_index_};
+}
+
+void LogDAL::RecycleSegments(size_t end) {
+    std::unique_lock lock(mutex_);
+    size_t first = end;
+    while (first > 0 && std::filesystem::exists(SegmentPath(first - 1))) {
+        --first;
+    }
+    size_t last = end;
+    while (std::filesystem::exists(SegmentPath(last))) {
+        ++last;
+    }
+    byte empty_header[kSegmentHeaderSize] = {};
+    for (size_t index = first; index < end; ++index, ++last) {
+        // Header is wiped, so the old records are never chained to the new ones
+        int fd = OpenSegment(index, false);
+        iovec part = {empty_header, kSegmentHeaderSize};
+        WriteFully(fd, &part, 1, 0);
+        Sync(fd);
+        std::filesystem::rename(SegmentPath(index), SegmentPath(last));
+        segment_fds_.erase(index);
+        segment_fds_[last] = fd;
+    }
+    if (first < end) {
+        SyncDirectory();
+    }
+}
+
+std::string LogDAL::SegmentPath(size_t index) const {
+    return path_ + "." + std::to_string(index);
+}
+
+int LogDAL::OpenSegment(size_t index, bool create) {
+    std::unique_lock lock(mutex_);
+    if (auto it = segment_fds_.find(index); it != segment_fds_.end()) {
+        return it->second;
+    }
+    bool created = create && !std::filesystem::exists(SegmentPath(index));
+    int fd = ::open(SegmentPath(index).c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) {
+        if (!create && errno == ENOENT) {
+            return -1;
+        }
+        throw dal_error::FileError("Log segment open failed.");
+    }
+    // Space is reserved once, so appends don't change file size
+    struct stat file_stat{};
+    if (::fstat(fd, &file_stat) != 0
+        || (create && static_cast<uint64_t>(file_stat.st_size) < segment_size_
+            && ::posix_fallocate(fd, 0, static_cast<off_t>(segment_size_)) != 0)) {
+        ::close(fd);
+        throw dal_error::FileError("Log segment allocation failed.");
+    }
+    if (created) {
+        // Size and directory entry of a new segment are synced once, frame writes don't change them
+        try {
+            Sync(fd);
+            SyncDirectory();
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+    }
+    segment_fds_[index] = fd;
+    return fd;
+}
+
+void LogDAL::Sync(int fd) {
+    if (::fdatasync(fd) != 0) {
+        throw dal_error::FileError("Log segment sync failed.");
+    }
+}
+
+void LogDAL::SyncDirectory() const {
+    auto directory = std::filesystem::absolute(path_).parent_path();
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw dal_error::FileError("Log directory open failed.");
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw dal_error::FileError("Log directory sync failed.");
+    }
+}
+
+void LogDAL::ReadFully(int fd, std::vector<byte>& buffer) {
+    struct stat file_stat{};
+    if (::fstat(fd, &file_stat) != 0) {
+        throw dal_error::FileError("Log segment stat failed.");
+    }
+    buffer.resize(file_stat.st_size);
+    size_t done = 0;
+    while (done < buffer.size()) {
+        auto result = ::pread(fd, buffer.data() + done, buffer.size() - done, static_cast<off_t>(done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw dal_error::FileError("Log segment read failed.");
+        }
+        done += result;
+    }
+}
+
+void LogDAL::WriteFully(int fd, iovec* parts, int count, uint64_t offset) {
+    while (count > 0) {
+        auto result = ::pwritev(fd, parts, count, static_cast<off_t>(offset));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw dal_error::FileError("Log file write failed.");
+        }
+        offset += result;
+        // Skip written parts after a short write
+        while (count > 0 && static_cast<size_t>(result) >= parts->iov_len) {
+            result -= parts->iov_len;
+            ++parts;
+            --count;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<byte*>(parts->iov_base) + result;
+            parts->iov_len -= result;
+        }
+    }
 }
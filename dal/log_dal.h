@@ -7,6 +7,18 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <optional>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "log.h"
 #include "page.h"
@@ -18,15 +30,52 @@
 
 class LogDAL {
 public:
+    /// @brief Log position, that separates records appended before and after it
+    struct Checkpoint {
+        // The first sequence and the first segment after the checkpoint
+        uint64_t sequence;
+        size_t segment;
+    };
+
     LogDAL(const std::string &path, const settings::UserSettings &user_settings);
 
     std::shared_ptr<LogMeta> GetMetaPtr();
 
+    /// @brief Calls visitor for each valid record in order. Segments are read one at a time,
+    /// payload is valid only during the call
+    void Replay(const std::function<void(uint64_t sequence, const byte* payload, size_t size)>& visitor);
+    /// @return Serialized valid records one after another
     std::vector<byte> ReadLogBuffer();
+    /// @brief Appends log and waits until it is written
     void WriteLog(const Log &log);
 
+    /// @brief Queues log for the next group write.
+    /// After a failed write log takes no records, until it is reopened
+    /// @return Sequence number of the log to wait for
+    uint64_t Append(const Log &log);
+    /// @brief Serializes log fields straight into the queue. Queue buffers are reused,
+    /// so there is no allocation per record
+    uint64_t Append(const Log::View &log);
+    /// @brief Queues logs as a single frame. They take successive sequences and are replayed all or none
+    /// @return Sequence number of the last log
+    uint64_t AppendBatch(const std::vector<Log> &logs);
+    /// @brief Waits for logs up to sequence with the durability of the settings
+    void WaitDurable(uint64_t sequence);
+    /// @brief kSync blocks until all logs up to sequence are written and synced.
+    /// The first waiter becomes a leader and writes the whole queue at once with a single sync, others wait for it.
+    /// kGroup blocks until the next periodic sync, kAsync only makes sure the periodic sync is running
+    void WaitDurable(uint64_t sequence, settings::Durability durability);
+
+    /// @return Sequence of the last appended log
+    uint64_t GetLastSequence();
+
+    /// @brief Writes queued logs and moves writing to a fresh segment, so the older records can be released
+    Checkpoint Rotate();
+    /// @brief Drops records before the checkpoint. Their segments are recycled
+    void Release(const Checkpoint& checkpoint);
+
     void ClearLogs();
-    void ClearLatest(uint64_t offset_to_end);
+    /// @brief Writes logs of asynchronous commits and closes the log
     void Close();
 
     ~LogDAL();
@@ -34,6 +83,56 @@ public:
 private:
     void WriteMeta();
     void ReadMeta();
+    struct Position {
+        size_t segment;
+        uint64_t offset;
+    };
+
+    /// @brief Takes the leader slot, writes queued logs and calls action before the slot is released
+    /// @param drop Queued logs are dropped instead of being written
+    /// @param action Takes sequence of the last taken log
+    void Lead(bool drop, const std::function<void(uint64_t)>& action);
+    /// @brief Starts the periodic sync, if it's not running. Called under queue_mutex_
+    void StartSyncer();
+    void StopSyncer();
+    /// @brief Writes queued logs every sync interval, until it's stopped or a write fails
+    void SyncLoop();
+    /// @brief Reserves queued frame of payload size and fills its header. Called under queue_mutex_
+    /// @return The first sequence of the frame
+    uint64_t QueueFrame(size_t size, uint32_t count);
+    /// @brief Computes checksum of the queued frame, once its payload is written
+    void SealFrame(size_t offset);
+    void WriteBatch(std::vector<byte>& batch);
+    /// @brief Moves writing to a fresh segment
+    Checkpoint NextSegment(uint64_t last_sequence);
+    /// @brief Renames segments before the end to follow the last one, so they are reused without allocation
+    void RecycleSegments(size_t end);
+    using FrameVisitor = std::function<void(uint64_t sequence, uint32_t count, const byte* payload, size_t size,
+                                            Position position)>;
+    /// @brief Reads valid frames through the chain of segments
+    /// @param visitor Is called for each frame, if not null
+    /// @return End of the last valid frame
+    Position ScanFrames(const FrameVisitor& visitor);
+    /// @brief Makes records after position invalid and moves writing past them
+    void CutTail(Position end);
+
+    std::string SegmentPath(size_t index) const;
+    /// @return File descriptor or -1, if segment doesn't exist and is not created
+    int OpenSegment(size_t index, bool create);
+    static void Sync(int fd);
+    /// @brief Makes creation of segment files durable
+    void SyncDirectory() const;
+    /// @brief Reads the whole file into buffer, which is reused between segments
+    static void ReadFully(int fd, std::vector<byte>& buffer);
+    static void WriteFully(int fd, iovec* parts, int count, uint64_t offset);
+
+    // Segment header: [first sequence][salt][crc32 of the rest]
+    static constexpr size_t kSegmentHeaderSize = 8 + 4 + 4;
+    // Frame: [crc32 of the rest xor segment salt][payload length][first sequence][record count][payload].
+    // Payload is serialized records one after another
+    static constexpr size_t kFrameHeaderSize = 4 + 4 + 8 + 4;
+    // Initial capacity of queue buffers. They grow to the largest batch and keep the capacity
+    static constexpr size_t kQueueCapacity = 64 * 1024;
 
     std::string path_;
     std::fstream file_;
@@ -41,7 +140,35 @@ private:
     const uint64_t meta_offset_ = 0;
     std::shared_ptr<LogMeta> meta_;
 
+    // Records are stored in preallocated segment files <path>.<index>. Live segments start from
+    // the first one in meta, released ones are renamed to follow them
+    uint64_t segment_size_;
+    std::map<size_t, int> segment_fds_;
+    // Write position, is restored by scan on open
+    size_t segment_index_ = 0;
+    uint64_t segment_offset_ = 0;
+    uint32_t segment_salt_ = 0;
+
     std::recursive_mutex mutex_;
+
+    // Group commit state, guarded by queue_mutex_
+    std::mutex queue_mutex_;
+    std::condition_variable durable_cv_;
+    // Logs are queued into pending_, while the leader writes batch_. Buffers are swapped by the next leader
+    std::vector<byte> pending_;
+    std::vector<byte> batch_;
+    uint64_t appended_sequence_ = 0;
+    uint64_t durable_sequence_ = 0;
+    bool leader_active_ = false;
+    // Error of a failed batch, log is broken after it
+    std::exception_ptr failure_;
+
+    // Periodic sync for kGroup and kAsync durability. Started by the first such commit
+    settings::Durability durability_;
+    std::chrono::microseconds sync_interval_;
+    std::thread syncer_;
+    std::condition_variable syncer_cv_;
+    bool syncer_stopped_ = false;
 };
 
 
@@ -1,187 +1,215 @@
 #include "memory_log_dal.h"
 
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "memory/memory.h"
+
 MemoryLogDAL::MemoryLogDAL(const std::string &path, const settings::UserSettings&)
-    : path_(path)
-    , meta_(new MemoryLogMeta()) {
-    bool file_exist = std::filesystem::exists(path);
-    if (file_exist) {
-        file_.open(path,  std::fstream::in | std::fstream::out);
-    } else {
-        file_.open(path,  std::fstream::in | std::fstream::out | std::fstream::trunc);
+    : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        throw dal_error::FileError("File open failed.");
     }
-
-    if (file_exist) {
-        ReadMeta();
-        ReadAllPages();
-    } else {
-        // Set up meta
-        meta_->SetDirtyPage(1);
-        meta_->SetAllocatedPage(2);
-        meta_->SetDataStartPage(3);
-        WriteMeta();
-        // Write empty ones by default
-        WriteNewPages();
-        WriteDirtyPages();
+    try {
+        ReadJournal();
+    } catch (...) {
+        ::close(fd_);
+        throw;
     }
 }
 
-std::shared_ptr<MemoryLogMeta> MemoryLogDAL::GetMetaPtr() {
-    return meta_;
-}
-
 void MemoryLogDAL::SavePage(const std::shared_ptr<Page> &page) {
-    if (!file_.is_open())
+    std::unique_lock lock(mutex_);
+    if (fd_ < 0)
         throw dal_error::FileError("File is closed");
-    auto saved_page_num = page->GetPageNum();
-    page->SetPageNum(meta_->GetDataStartPage() + dirty_pages_.GetDataPtr()->size());
-    WritePage(page);
-    // Return page_num state
-    page->SetPageNum(saved_page_num);
-
-    dirty_pages_.GetDataPtr()->push_back(saved_page_num);
-    WriteDirtyPages();
+    // Image is copied, as the caller may reuse the page
+    auto image = std::make_shared<Page>(settings::kPageSize);
+    image->SetPageNum(page->GetPageNum());
+    std::memcpy(image->Data(), page->Data(), settings::kPageSize);
+    saved_pages_.emplace_back(page->GetPageNum(), image);
+    AppendFrame(RecordType::kPage, page->GetPageNum(), page->Data(), settings::kPageSize);
 }
 
-void MemoryLogDAL::SavePageAllocation(uint64_t page_num) {
-    if (!file_.is_open())
+void MemoryLogDAL::SavePageRange(uint64_t page_num, uint32_t offset, const byte* data, uint32_t size) {
+    std::unique_lock lock(mutex_);
+    if (fd_ < 0)
         throw dal_error::FileError("File is closed");
 
-    new_pages_.GetDataPtr()->push_back(page_num);
-    WriteNewPages();
+    saved_ranges_.push_back({page_num, offset, std::vector<byte>(data, data + size)});
+    std::vector<byte> payload(4 + size);
+    memory::uint32_to_bytes(payload.data(), offset);
+    std::memcpy(payload.data() + 4, data, size);
+    AppendFrame(RecordType::kRange, page_num, payload.data(), payload.size());
 }
 
-std::vector<std::pair<uint64_t, std::shared_ptr<Page>>> MemoryLogDAL::GetSavedPages() {
-    if (!file_.is_open())
+void MemoryLogDAL::SavePageAllocation(uint64_t page_num) {
+    std::unique_lock lock(mutex_);
+    if (fd_ < 0)
         throw dal_error::FileError("File is closed");
 
-    std::vector<std::pair<uint64_t, std::shared_ptr<Page>>> result;
-
-    for (size_t i = 0; i < dirty_pages_.GetDataPtr()->size(); ++i) {
-        auto page_num = meta_->GetDataStartPage() + i;
-        auto page = ReadPage(page_num);
-        result.emplace_back(dirty_pages_.GetDataPtr()->operator[](i), page);
-    }
-    return result;
+    allocations_.push_back(page_num);
+    AppendFrame(RecordType::kAllocation, page_num, nullptr, 0);
 }
 
-std::vector<uint64_t> MemoryLogDAL::GetSavedPageAllocations() {
-    if (!file_.is_open())
+void MemoryLogDAL::Commit() {
+    std::unique_lock lock(mutex_);
+    if (batch_.empty()) {
+        return;
+    }
+    if (fd_ < 0)
         throw dal_error::FileError("File is closed");
-
-    return *new_pages_.GetDataPtr();
+    AppendFrame(RecordType::kCommit, RecordCount(), nullptr, 0);
+
+    size_t done = 0;
+    while (done < batch_.size()) {
+        auto result = ::pwrite(fd_, batch_.data() + done, batch_.size() - done, static_cast<off_t>(done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw dal_error::FileError("File write failed.");
+        }
+        done += result;
+    }
+    // The only sync of the operation. Pages are written in place only after it
+    if (::fdatasync(fd_) != 0) {
+        throw dal_error::FileError("File sync failed.");
+    }
+    file_size_ = batch_.size();
+    batch_.clear();
+    committed_ = true;
 }
 
-void MemoryLogDAL::Clear() {
-    dirty_pages_.Clear();
-    new_pages_.Clear();
-
-    // Open close to clear logs
-    file_.close();
-    file_.open(path_,  std::fstream::in | std::fstream::out | std::fstream::trunc);
-
-    // Set up meta
-    meta_->SetDirtyPage(1);
-    meta_->SetAllocatedPage(2);
-    meta_->SetDataStartPage(3);
-    WriteMeta();
-    // Write empty ones by default
-    WriteNewPages();
-    WriteDirtyPages();
+bool MemoryLogDAL::IsCommitted() const {
+    return committed_;
 }
 
-void MemoryLogDAL::Close() {
+std::vector<std::pair<uint64_t, std::shared_ptr<Page>>> MemoryLogDAL::GetSavedPages() {
     std::unique_lock lock(mutex_);
-    if (!file_.is_open())
+    if (fd_ < 0)
         throw dal_error::FileError("File is closed");
 
-    file_.close();
+    return saved_pages_;
 }
 
-MemoryLogDAL::~MemoryLogDAL() {
+std::vector<MemoryLogDAL::Range> MemoryLogDAL::GetSavedRanges() {
     std::unique_lock lock(mutex_);
-    if (file_.is_open()) {
-        Close();
-    }
-}
+    if (fd_ < 0)
+        throw dal_error::FileError("File is closed");
 
-std::shared_ptr<Page> MemoryLogDAL::AllocateEmptyPage() {
-    return std::make_shared<Page>(settings::kPageSize);
+    return saved_ranges_;
 }
 
-std::shared_ptr<Page> MemoryLogDAL::ReadPage(uint64_t page_num) {
+std::vector<uint64_t> MemoryLogDAL::GetSavedPageAllocations() {
     std::unique_lock lock(mutex_);
+    if (fd_ < 0)
+        throw dal_error::FileError("File is closed");
 
-    std::shared_ptr<Page> page = AllocateEmptyPage();
-    // Page offset in file
-    uint64_t offset = page_num * settings::kPageSize;
-    // Retrieve page from file
-    file_.seekg(offset);
-    if (file_.fail()) {
-        throw dal_error::FileError("File is corrupted.");
-    }
-    file_.readsome(page->Data(), settings::kPageSize);
-    if (file_.fail()) {
-        throw dal_error::FileError("File read failed.");
-    }
-
-    return page;
+    return allocations_;
 }
 
-void MemoryLogDAL::WritePage(const std::shared_ptr<Page> &page) {
+void MemoryLogDAL::Clear() {
     std::unique_lock lock(mutex_);
-
-    uint64_t offset = page->GetPageNum() * settings::kPageSize;
-    // Write page into file
-    file_.seekp(offset);
-    if (file_.fail()) {
-        throw dal_error::FileError("File is corrupted.");
-    }
-    file_.write(page->Data(), settings::kPageSize);
-    if (file_.fail()) {
-        throw dal_error::FileError("File write failed.");
+    // Operation without changes leaves nothing to clear
+    if (batch_.empty() && RecordCount() == 0 && file_size_ == 0) {
+        return;
     }
-    // Flush is important to keep data up to date
-    file_.flush();
-    if (file_.fail()) {
-        throw dal_error::FileError("File flush failed.");
+    batch_.clear();
+    saved_pages_.clear();
+    saved_ranges_.clear();
+    allocations_.clear();
+    committed_ = false;
+
+    // Journal is not synced after the truncation. If it survives a crash, the finished operation is undone,
+    // which leaves the tree consistent, and its records are still in the log
+    if (file_size_ != 0 && ::ftruncate(fd_, 0) != 0) {
+        throw dal_error::FileError("File truncate failed.");
     }
+    file_size_ = 0;
 }
 
-void MemoryLogDAL::WriteMeta() {
-    std::shared_ptr<Page> page = AllocateEmptyPage();
-    page->SetPageNum(meta_page_num_);
-
-    meta_->Serialize(page->Data(), settings::kPageSize);
-    WritePage(page);
-}
+void MemoryLogDAL::Close() {
+    std::unique_lock lock(mutex_);
+    if (fd_ < 0)
+        throw dal_error::FileError("File is closed");
 
-void MemoryLogDAL::ReadMeta() {
-    std::shared_ptr<Page> page = ReadPage(meta_page_num_);
-    meta_->Deserialize(page->Data(), settings::kPageSize);
+    ::close(fd_);
+    fd_ = -1;
 }
 
-void MemoryLogDAL::WriteDirtyPages() {
-    std::shared_ptr<Page> page = AllocateEmptyPage();
-    page->SetPageNum(meta_->GetDirtyPage());
-
-    dirty_pages_.Serialize(page->Data(), settings::kPageSize);
-    WritePage(page);
+MemoryLogDAL::~MemoryLogDAL() {
+    std::unique_lock lock(mutex_);
+    if (fd_ >= 0) {
+        Close();
+    }
 }
 
-void MemoryLogDAL::WriteNewPages() {
-    std::shared_ptr<Page> page = AllocateEmptyPage();
-    page->SetPageNum(meta_->GetAllocatedPage());
-
-    new_pages_.Serialize(page->Data(), settings::kPageSize);
-    WritePage(page);
+size_t MemoryLogDAL::RecordCount() const {
+    return saved_pages_.size() + saved_ranges_.size() + allocations_.size();
 }
 
-void MemoryLogDAL::ReadAllPages() {
-    auto dirty_page = ReadPage(meta_->GetDirtyPage());
-    auto new_page = ReadPage(meta_->GetAllocatedPage());
-
-    dirty_pages_.Deserialize(dirty_page->Data(), settings::kPageSize);
-    new_pages_.Deserialize(new_page->Data(), settings::kPageSize);
+void MemoryLogDAL::AppendFrame(RecordType type, uint64_t page_num, const byte* payload, uint32_t size) {
+    auto offset = batch_.size();
+    batch_.resize(offset + kFrameHeaderSize + size);
+    byte* frame = batch_.data() + offset;
+    frame[4] = static_cast<byte>(type);
+    memory::uint64_to_bytes(frame + 5, page_num);
+    memory::uint32_to_bytes(frame + 13, size);
+    if (size > 0) {
+        std::memcpy(frame + kFrameHeaderSize, payload, size);
+    }
+    memory::uint32_to_bytes(frame, memory::crc32(frame + 4, kFrameHeaderSize - 4 + size));
+}
+
+void MemoryLogDAL::ReadJournal() {
+    std::vector<byte> buffer(std::filesystem::file_size(path_));
+    size_t done = 0;
+    while (done < buffer.size()) {
+        auto result = ::pread(fd_, buffer.data() + done, buffer.size() - done, static_cast<off_t>(done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw dal_error::FileError("File read failed.");
+        }
+        done += result;
+    }
+    file_size_ = buffer.size();
+
+    // Scan stops on the first torn or corrupted frame. Records count only with the commit frame after them
+    size_t offset = 0;
+    while (buffer.size() - offset >= kFrameHeaderSize) {
+        const byte* frame = buffer.data() + offset;
+        uint32_t size = memory::bytes_to_uint32(frame + 13);
+        if (buffer.size() - offset - kFrameHeaderSize < size
+            || memory::crc32(frame + 4, kFrameHeaderSize - 4 + size) != memory::bytes_to_uint32(frame)) {
+            break;
+        }
+        auto type = static_cast<RecordType>(frame[4]);
+        uint64_t page_num = memory::bytes_to_uint64(frame + 5);
+        if (type == RecordType::kPage && size == settings::kPageSize) {
+            auto page = std::make_shared<Page>(settings::kPageSize);
+            page->SetPageNum(page_num);
+            std::memcpy(page->Data(), frame + kFrameHeaderSize, size);
+            saved_pages_.emplace_back(page_num, page);
+        } else if (type == RecordType::kRange && size >= 4) {
+            auto range_offset = memory::bytes_to_uint32(frame + kFrameHeaderSize);
+            const byte* data = frame + kFrameHeaderSize + 4;
+            saved_ranges_.push_back({page_num, range_offset, std::vector<byte>(data, data + size - 4)});
+        } else if (type == RecordType::kAllocation) {
+            allocations_.push_back(page_num);
+        } else if (type == RecordType::kCommit) {
+            committed_ = page_num == RecordCount();
+            break;
+        }
+        offset += kFrameHeaderSize + size;
+    }
+    if (!committed_) {
+        saved_pages_.clear();
+        saved_ranges_.clear();
+        allocations_.clear();
+    }
 }
-
-
@@ -1,35 +1,50 @@
 #ifndef ANILOP_MEMORYLOGDAL_H_
 #define ANILOP_MEMORYLOGDAL_H_
 
-#include <fstream>
-#include <filesystem>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 
-#include "log.h"
 #include "page.h"
-#include "meta.h"
-#include "num_list.h"
 
 #include "memory/type.h"
 #include "settings/settings.h"
 #include "exception/exception.h"
 
-
+/// @brief Undo journal of a single tree operation.
+/// Before-images of pages or of their changed byte ranges and page allocations are queued in memory
+/// and written as one batch with a single sync, before the operation writes pages in place.
+/// Batch without the commit frame is ignored on open
 class MemoryLogDAL {
 public:
-    MemoryLogDAL(const std::string &path, const settings::UserSettings &user_settings);
+    /// @brief Old bytes of a page part
+    struct Range {
+        uint64_t page_num;
+        uint32_t offset;
+        std::vector<byte> data;
+    };
 
-    std::shared_ptr<MemoryLogMeta> GetMetaPtr();
+    MemoryLogDAL(const std::string &path, const settings::UserSettings &user_settings);
 
+    /// @brief Queues full before-image of page
     void SavePage(const std::shared_ptr<Page> &page);
+    /// @brief Queues old bytes of a page part, that is changed by the operation
+    void SavePageRange(uint64_t page_num, uint32_t offset, const byte* data, uint32_t size);
     void SavePageAllocation(uint64_t page_num);
 
+    /// @brief Writes queued records with the commit frame and syncs them. Pages may be written in place after it
+    void Commit();
+    /// @return Whether the journal holds a committed batch, which pages may be partially written
+    bool IsCommitted() const;
+
     std::vector<std::pair<uint64_t, std::shared_ptr<Page>>> GetSavedPages();
+    std::vector<Range> GetSavedRanges();
     std::vector<uint64_t> GetSavedPageAllocations();
 
+    /// @brief Drops the journal, when the operation is finished or rolled back.
+    /// Does no I/O, if nothing was saved
     void Clear();
 
     void Close();
@@ -37,26 +52,34 @@ public:
     ~MemoryLogDAL();
 
 private:
-    std::shared_ptr<Page> AllocateEmptyPage();
+    enum class RecordType : byte {
+        kPage = 1,
+        kAllocation = 2,
+        // Number of records in the batch
+        kCommit = 3,
+        // Payload: [offset][old bytes]
+        kRange = 4
+    };
 
-    std::shared_ptr<Page> ReadPage(uint64_t page_num);
-    void WritePage(const std::shared_ptr<Page>& page);
+    size_t RecordCount() const;
 
-    void WriteMeta();
-    void ReadMeta();
+    void AppendFrame(RecordType type, uint64_t page_num, const byte* payload, uint32_t size);
+    /// @brief Restores the committed batch, if there is one
+    void ReadJournal();
 
-    void WriteDirtyPages();
-    void WriteNewPages();
-    void ReadAllPages();
+    // Frame: [crc32 of the rest][type][page num][payload length][payload]
+    static constexpr size_t kFrameHeaderSize = 4 + 1 + 8 + 4;
 
     std::string path_;
-    std::fstream file_;
-
-    const uint64_t meta_page_num_ = 0;
-    std::shared_ptr <MemoryLogMeta> meta_;
-
-    NumList dirty_pages_;
-    NumList new_pages_;
+    int fd_ = -1;
+    // Bytes in the file
+    uint64_t file_size_ = 0;
+
+    std::vector<byte> batch_;
+    std::vector<std::pair<uint64_t, std::shared_ptr<Page>>> saved_pages_;
+    std::vector<Range> saved_ranges_;
+    std::vector<uint64_t> allocations_;
+    bool committed_ = false;
 
     std::recursive_mutex mutex_;
 };
@@ -30,7 +30,7 @@ size_t Meta::Serialize(byte* data, size_t max_volume) const {
     size_t o_base_size = BaseT::Serialize(data, max_volume);
     data += o_base_size;
 
-    size_t o_size = 3 * uint64_t_size;
+    size_t o_size = 6 * uint64_t_size;
     if (max_volume < o_size) {
         throw dal_error::CorruptedBuffer("Buffer is too low for serialization.");
     }
@@ -38,6 +38,14 @@ size_t Meta::Serialize(byte* data, size_t max_volume) const {
     memory::uint64_to_bytes(data, root_);
     data += uint64_t_size;
     memory::uint64_to_bytes(data, free_list_page_);
+    data += uint64_t_size;
+    memory::uint64_to_bytes(data, comparator_);
+    data += uint64_t_size;
+    memory::uint64_to_bytes(data, key_type_);
+    data += uint64_t_size;
+    memory::uint64_to_bytes(data, comparator_id_);
+    data += uint64_t_size;
+    memory::uint64_to_bytes(data, engine_);
 
     return o_base_size + o_size;
 }
@@ -46,7 +54,7 @@ size_t Meta::Deserialize(const byte* data, size_t max_volume) {
     size_t r_base_size = BaseT::Deserialize(data, max_volume);
     data += r_base_size;
 
-    size_t r_size = 3 * uint64_t_size;
+    size_t r_size = 6 * uint64_t_size;
     if (max_volume < r_size) {
         throw dal_error::CorruptedBuffer("Buffer is too low for deserialization.");
     }
@@ -54,6 +62,14 @@ size_t Meta::Deserialize(const byte* data, size_t max_volume) {
     root_ = memory::bytes_to_uint64(data);
     data += uint64_t_size;
     free_list_page_ = memory::bytes_to_uint64(data);
+    data += uint64_t_size;
+    comparator_ = memory::bytes_to_uint64(data);
+    data += uint64_t_size;
+    key_type_ = memory::bytes_to_uint64(data);
+    data += uint64_t_size;
+    comparator_id_ = memory::bytes_to_uint64(data);
+    data += uint64_t_size;
+    engine_ = memory::bytes_to_uint64(data);
 
     return r_base_size + r_size;
 }
@@ -72,7 +88,7 @@ void Meta::SetRootPage(uint64_t page) {
 
 size_t Meta::GetSize() const {
     auto base_size = BaseT::GetSize();
-    return base_size + (3 * uint64_t_size);
+    return base_size + (6 * uint64_t_size);
 }
 
 
@@ -80,70 +96,33 @@ size_t LogMeta::Serialize(byte *data, size_t max_volume) const {
     size_t o_base_size = BaseT::Serialize(data, max_volume);
     data += o_base_size;
 
-    size_t o_size = uint64_t_size;
+    size_t o_size = 2 * uint64_t_size;
     if (max_volume < o_size) {
         throw dal_error::CorruptedBuffer("Buffer is too low for serialization.");
     }
-    memory::uint64_to_bytes(data, data_end_offset_);
-
-    return o_base_size + o_size;
-}
-
-size_t LogMeta::Deserialize(const byte *data, size_t max_volume) {
-    size_t r_base_size = BaseT::Deserialize(data, max_volume);
-    data += r_base_size;
-
-    size_t r_size = uint64_t_size;
-    if (max_volume < r_size) {
-        throw dal_error::CorruptedBuffer("Buffer is too low for deserialization.");
-    }
-    data_end_offset_ = memory::bytes_to_uint64(data);
-
-    return r_base_size + r_size;
-}
-
-size_t LogMeta::GetSize() const {
-    auto base_size = BaseT::GetSize();
-    return base_size + uint64_t_size;
-}
-
-size_t MemoryLogMeta::Serialize(byte *data, size_t max_volume) const {
-    size_t o_base_size = BaseT::Serialize(data, max_volume);
-    data += o_base_size;
-
-    size_t o_size = 3 * uint64_t_size;
-    if (max_volume < o_size) {
-        throw dal_error::CorruptedBuffer("Buffer is too low for serialization.");
-    }
-
-    memory::uint64_to_bytes(data, dirty_page_);
-    data += uint64_t_size;
-    memory::uint64_to_bytes(data, allocated_page_);
+    memory::uint64_to_bytes(data, start_sequence_);
     data += uint64_t_size;
-    memory::uint64_to_bytes(data, data_page_);
+    memory::uint64_to_bytes(data, first_segment_);
 
     return o_base_size + o_size;
 }
 
-size_t MemoryLogMeta::Deserialize(const byte *data, size_t max_volume) {
+size_t LogMeta::Deserialize(const byte *data, size_t max_volume) {
     size_t r_base_size = BaseT::Deserialize(data, max_volume);
     data += r_base_size;
 
-    size_t r_size = 3 * uint64_t_size;
+    size_t r_size = 2 * uint64_t_size;
     if (max_volume < r_size) {
         throw dal_error::CorruptedBuffer("Buffer is too low for deserialization.");
     }
-
-    dirty_page_ = memory::bytes_to_uint64(data);
+    start_sequence_ = memory::bytes_to_uint64(data);
     data += uint64_t_size;
-    allocated_page_ = memory::bytes_to_uint64(data);
-    data += uint64_t_size;
-    data_page_ = memory::bytes_to_uint64(data);
+    first_segment_ = memory::bytes_to_uint64(data);
 
     return r_base_size + r_size;
 }
 
-size_t MemoryLogMeta::GetSize() const {
+size_t LogMeta::GetSize() const {
     auto base_size = BaseT::GetSize();
-    return base_size + (3 * uint64_t_size);
+    return base_size + 2 * uint64_t_size;
 }
@@ -33,12 +33,28 @@ class Meta : public IMeta {
     void SetFreeListPage(uint64_t page);
     uint64_t GetRootPage();
     void SetRootPage(uint64_t page);
+    uint64_t GetComparator() const { return comparator_; }
+    void SetComparator(uint64_t comparator) { comparator_ = comparator; }
+    uint64_t GetKeyType() const { return key_type_; }
+    void SetKeyType(uint64_t key_type) { key_type_ = key_type; }
+    uint64_t GetComparatorId() const { return comparator_id_; }
+    void SetComparatorId(uint64_t comparator_id) { comparator_id_ = comparator_id; }
+    uint64_t GetEngine() const { return engine_; }
+    void SetEngine(uint64_t engine) { engine_ = engine; }
 
 protected:
     std::string GetMagicWord() const override { return "ANILOPDB"; };
 
     uint64_t free_list_page_ = 0;
     uint64_t root_ = 0;
+    // Key order of the tree
+    uint64_t comparator_ = 0;
+    // Format of keys in nodes
+    uint64_t key_type_ = 0;
+    // Checksum of custom comparator name
+    uint64_t comparator_id_ = 0;
+    // Storage engine of the table
+    uint64_t engine_ = 0;
 };
 
 class LogMeta : public IMeta {
@@ -50,40 +66,19 @@ public:
 
     size_t GetSize() const override;
 
-    uint64_t GetDataEndOffset() { return data_end_offset_; };
-    void SetDataEndOffset(uint64_t data_end_offset) { data_end_offset_ = data_end_offset; };
+    // Sequence number of the first log record in file
+    uint64_t GetStartSequence() const { return start_sequence_; };
+    void SetStartSequence(uint64_t sequence) { start_sequence_ = sequence; };
+    // Index of the segment, that holds the start sequence
+    uint64_t GetFirstSegment() const { return first_segment_; };
+    void SetFirstSegment(uint64_t segment) { first_segment_ = segment; };
 
 protected:
     std::string GetMagicWord() const override { return "ANILOPDBLOG"; }
 
 private:
-    uint64_t data_end_offset_ = 0;
-};
-
-class MemoryLogMeta : public IMeta {
-    using BaseT = IMeta;
-
-public:
-    size_t Serialize(byte* data, size_t max_volume) const override;
-    size_t Deserialize(const byte* data, size_t max_volume) override;
-
-    size_t GetSize() const override;
-
-    uint64_t GetDataStartPage() const { return data_page_; };
-    void SetDataStartPage(uint64_t page) { data_page_ = page; }
-
-    uint64_t GetDirtyPage() const { return dirty_page_; }
-    void SetDirtyPage(uint64_t page) { dirty_page_ = page; }
-    uint64_t GetAllocatedPage() const { return allocated_page_; }
-    void SetAllocatedPage(uint64_t page) { allocated_page_ = page; }
-
-protected:
-    std::string GetMagicWord() const override { return "ANILOPDBMLOG"; }
-
-private:
-    uint64_t dirty_page_ = 0;
-    uint64_t allocated_page_ = 0;
-    uint64_t data_page_ = 0;
+    uint64_t start_sequence_ = 1;
+    uint64_t first_segment_ = 0;
 };
 
 #endif  // META_H_
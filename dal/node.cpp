@@ -4,6 +4,18 @@ Node::Node() {}
 
 bool Node::IsLeaf() const { return child_nodes_.size() == 0; }
 
+void Node::SetFixedKeys(bool fixed_keys) {
+    fixed_keys_ = fixed_keys;
+}
+
+bool Node::HasFixedKeys() const {
+    return fixed_keys_;
+}
+
+const std::vector<uint64_t>& Node::PackedKeys() const {
+    return packed_keys_;
+}
+
 void Node::SetPageNum(uint64_t page_num) {
     page_num_ = page_num;
 }
@@ -13,24 +25,54 @@ uint64_t Node::GetPageNum() const {
 }
 
 void Node::AddItem(const std::shared_ptr<Item>& item, size_t pos) {
+    packed_keys_.clear();
     items_.insert(items_.begin() + pos, item);
 }
 
 std::vector<uint64_t>* Node::ChildNodesPtr() { return &child_nodes_; }
 
-std::vector<std::shared_ptr<Item>>* Node::ItemsPtr() { return &items_; }
+std::vector<std::shared_ptr<Item>>* Node::ItemsPtr() {
+    // Items may be changed by caller
+    packed_keys_.clear();
+    return &items_;
+}
+
+const std::vector<std::shared_ptr<Item>>& Node::Items() const {
+    return items_;
+}
 
 size_t Node::HeaderByteLength() const {
     size_t length = 1 + 2;  // leaf_bit, len of pairs
     length += items_.size() * uint64_t_size;  // offsets
     length += child_nodes_.size() * uint64_t_size;  // child pointers
+    if (fixed_keys_) {
+        length += items_.size() * uint64_t_size;  // packed keys
+    }
+    return length;
+}
+
+size_t Node::ItemHeaderByteLength() const {
+    size_t length = uint64_t_size;  // offset
+    if (!child_nodes_.empty()) {
+        length += uint64_t_size;  // child pointer
+    }
+    if (fixed_keys_) {
+        length += uint64_t_size;  // packed key
+    }
     return length;
 }
 
+size_t Node::ItemByteLength(size_t index) const {
+    if (fixed_keys_) {
+        return items_[index]->ValueSize();
+    }
+    return items_[index]->ByteLength();
+}
+
 size_t Node::ByteLength() const {
     size_t length = HeaderByteLength();
-    for (const auto& item : items_) {
-        length += item->ByteLength();
+    for (size_t i = 0; i < items_.size(); ++i) {
+        length += ItemByteLength(i);
     }
     return length;
 }
@@ -39,12 +81,15 @@ size_t Node::Serialize(byte* data, size_t max_volume) const {
     if (max_volume < ByteLength()) {
         throw dal_error::CorruptedBuffer("Buffer size is too low for serialisation."); 
     }
-    // Serialize leaf status
-    char leaf_bit = 0; 
+    // Serialize leaf status and key format
+    char flags = 0;
     if (IsLeaf()) {
-        leaf_bit = 1;
+        flags |= kLeafFlag;
     }
-    data[0] = leaf_bit;
+    if (fixed_keys_) {
+        flags |= kFixedKeysFlag;
+    }
+    data[0] = flags;
     data += 1;
     max_volume -= 1;
     // Serialize len of key-value pairs
@@ -54,26 +99,36 @@ size_t Node::Serialize(byte* data, size_t max_volume) const {
     // Serialize header and item footer
     char* left_ptr = data;
     char* right_ptr = data + max_volume;
+    if (fixed_keys_) {  // Serialize packed keys
+        for (const auto& item : items_) {
+            std::memcpy(left_ptr, item->KeyData(), uint64_t_size);
+            left_ptr += uint64_t_size;
+        }
+    }
     for (size_t i = 0; i < items_.size(); ++i) {
         std::shared_ptr<Item> item = items_[i];
         
         if (!IsLeaf()) {  // Serialize child node page_num 
             uint64_t child_node = child_nodes_[i];
-            memory::uint64_to_bytes(data, child_node);
+            memory::uint64_to_bytes(left_ptr, child_node);
             left_ptr += uint64_t_size;
         }
 
         // Serialize offset
-        size_t offset = item->ByteLength();
+        size_t offset = ItemByteLength(i);
         memory::uint64_to_bytes(left_ptr, offset);
         left_ptr += uint64_t_size;
-        // Serialize item
+        // Serialize item. Fixed keys node keeps only values, their size is the offset
         right_ptr -= offset;
-        item->Serialize(right_ptr, item->ByteLength());
+        if (fixed_keys_) {
+            std::memcpy(right_ptr, item->ValueData(), offset);
+        } else {
+            item->Serialize(right_ptr, offset);
+        }
     }
     // Serialize last child
     if (!IsLeaf()) {
-        memory::uint64_to_bytes(data, child_nodes_.back());
+        memory::uint64_to_bytes(left_ptr, child_nodes_.back());
     }
 
     return max_volume;
@@ -82,9 +137,11 @@ size_t Node::Serialize(byte* data, size_t max_volume) const {
 size_t Node::Deserialize(const byte* data, size_t max_volume) {
     items_.clear();
     child_nodes_.clear(); 
-    // Deserialize leaf status
-    char leaf_bit = 0; 
-    leaf_bit = data[0];
+    packed_keys_.clear();
+    // Deserialize leaf status and key format
+    char flags = data[0];
+    char leaf_bit = flags & kLeafFlag;
+    fixed_keys_ = (flags & kFixedKeysFlag) != 0;
     
     data += 1;
     max_volume -= 1;
@@ -95,11 +152,18 @@ size_t Node::Deserialize(const byte* data, size_t max_volume) {
     // Deserialize header and item footer
     const char* left_ptr = data;
     const char* right_ptr = data + max_volume;
+    if (fixed_keys_) {  // Deserialize packed keys
+        CheckPtrInterDeser(left_ptr + items_size * uint64_t_size, right_ptr);
+        packed_keys_.resize(items_size);
+        for (size_t i = 0; i < items_size; ++i) {
+            packed_keys_[i] = memory::bytes_to_uint64(left_ptr);
+            left_ptr += uint64_t_size;
+        }
+    }
     for (size_t i = 0; i < items_size; ++i) {
-        Item* item = new Item;
         
         if (leaf_bit == 0) {  // Deserialize child node page_num
-            child_nodes_.emplace_back(memory::bytes_to_uint64(data));
+            child_nodes_.emplace_back(memory::bytes_to_uint64(left_ptr));
             left_ptr += uint64_t_size;
             CheckPtrInterDeser(left_ptr, right_ptr);
         }
@@ -111,9 +175,15 @@ size_t Node::Deserialize(const byte* data, size_t max_volume) {
         // Deserialize item
         right_ptr -= offset;
         CheckPtrInterDeser(left_ptr, right_ptr);
-        item->Deserialize(right_ptr, offset);
-
-        items_.emplace_back(item);
+        if (fixed_keys_) {
+            std::vector<byte> key(uint64_t_size);
+            memory::uint64_to_bytes(key.data(), packed_keys_[i]);
+            items_.emplace_back(new Item(std::move(key), {right_ptr, right_ptr + offset}));
+        } else {
+            Item* item = new Item;
+            item->Deserialize(right_ptr, offset);
+            items_.emplace_back(item);
+        }
     }
     // Deserialize last child
     if (leaf_bit == 0) {
@@ -19,15 +19,27 @@ class Node : public ISerializable {
 
     bool IsLeaf() const;
 
+    /// @brief Node stores 8 byte keys as packed array without per-key lengths
+    void SetFixedKeys(bool fixed_keys);
+    bool HasFixedKeys() const;
+    /// @brief Keys of fixed keys node, as they were read from the page
+    /// @warning Empty, when items could be changed after the read
+    const std::vector<uint64_t>& PackedKeys() const;
+
     void SetPageNum(uint64_t page_num);
     uint64_t GetPageNum() const;
 
     void AddItem(const std::shared_ptr<Item>& item, size_t pos);
 
     std::vector<uint64_t>* ChildNodesPtr();
+    /// @brief Mutable items. Drops packed keys, as they may be changed by the caller
     std::vector<std::shared_ptr<Item>>* ItemsPtr();
+    const std::vector<std::shared_ptr<Item>>& Items() const;
 
     size_t HeaderByteLength() const;
+    /// @brief Part of the header, taken by each item
+    size_t ItemHeaderByteLength() const;
+    size_t ItemByteLength(size_t index) const;
     size_t ByteLength() const;
 
     size_t Serialize(byte* data, size_t max_volume) const override;
@@ -36,9 +48,15 @@ class Node : public ISerializable {
    private:
     void CheckPtrInterDeser(const char* left, const char* right);
 
+    static constexpr byte kLeafFlag = 1;
+    static constexpr byte kFixedKeysFlag = 2;
+
     uint64_t page_num_;
     std::vector<uint64_t> child_nodes_;
     std::vector<std::shared_ptr<Item>> items_;
+
+    bool fixed_keys_ = false;
+    std::vector<uint64_t> packed_keys_;
 };
 
 #endif  // NODE_H_
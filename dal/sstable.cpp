@@ -0,0 +1,314 @@
+#include "sstable.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory/memory.h"
+
+namespace {
+
+// [command][key size][value size]
+constexpr size_t kRecordHeaderSize = 1 + 4 + 4;
+constexpr size_t kChecksumSize = 4;
+// [index offset][index size][filter offset][filter size][entries][crc32 of the rest][magic]
+constexpr size_t kFooterSize = 5 * 8 + 4 + 4;
+constexpr uint32_t kMagic = 0x4C534D31;
+
+}  // namespace
+
+SSTableBuilder::SSTableBuilder(const std::string& path, size_t keys, size_t bloom_bits_per_key)
+    : path_(path)
+    , filter_(keys, bloom_bits_per_key) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw dal_error::FileError("Run file open failed.");
+    }
+}
+
+SSTableBuilder::~SSTableBuilder() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (!finished_) {
+        std::filesystem::remove(path_);
+    }
+}
+
+void SSTableBuilder::Add(Log::Command command, std::string_view key, std::string_view value) {
+    auto offset = block_.size();
+    block_.resize(offset + kRecordHeaderSize + key.size() + value.size());
+    byte* record = block_.data() + offset;
+    record[0] = static_cast<byte>(command);
+    memory::uint32_to_bytes(record + 1, key.size());
+    memory::uint32_to_bytes(record + 5, value.size());
+    std::memcpy(record + kRecordHeaderSize, key.data(), key.size());
+    std::memcpy(record + kRecordHeaderSize + key.size(), value.data(), value.size());
+
+    filter_.Add(key);
+    last_key_.assign(key.data(), key.size());
+    ++entries_;
+    if (block_.size() >= SSTable::kBlockSize) {
+        FlushBlock();
+    }
+}
+
+void SSTableBuilder::Finish() {
+    FlushBlock();
+
+    // Index is a block of its own, it's checked the same way
+    uint64_t index_offset = offset_;
+    auto index_size = index_.size();
+    index_.resize(index_size + kChecksumSize);
+    memory::uint32_to_bytes(index_.data() + index_size, memory::crc32(index_.data(), index_size));
+    Write(index_);
+
+    uint64_t filter_offset = offset_;
+    Write(filter_.Data());
+
+    std::vector<byte> footer(kFooterSize);
+    memory::uint64_to_bytes(footer.data(), index_offset);
+    memory::uint64_to_bytes(footer.data() + 8, index_.size());
+    memory::uint64_to_bytes(footer.data() + 16, filter_offset);
+    memory::uint64_to_bytes(footer.data() + 24, filter_.Data().size());
+    memory::uint64_to_bytes(footer.data() + 32, entries_);
+    memory::uint32_to_bytes(footer.data() + 40, memory::crc32(footer.data(), 40));
+    memory::uint32_to_bytes(footer.data() + 44, kMagic);
+    Write(footer);
+
+    if (::fdatasync(fd_) != 0) {
+        throw dal_error::FileError("Run file sync failed.");
+    }
+    finished_ = true;
+}
+
+void SSTableBuilder::FlushBlock() {
+    if (block_.empty()) {
+        return;
+    }
+    auto size = block_.size();
+    block_.resize(size + kChecksumSize);
+    memory::uint32_to_bytes(block_.data() + size, memory::crc32(block_.data(), size));
+
+    auto index_offset = index_.size();
+    index_.resize(index_offset + 4 + last_key_.size() + 16);
+    byte* handle = index_.data() + index_offset;
+    memory::uint32_to_bytes(handle, last_key_.size());
+    std::memcpy(handle + 4, last_key_.data(), last_key_.size());
+    memory::uint64_to_bytes(handle + 4 + last_key_.size(), offset_);
+    memory::uint64_to_bytes(handle + 12 + last_key_.size(), block_.size());
+
+    Write(block_);
+    block_.clear();
+}
+
+void SSTableBuilder::Write(const std::vector<byte>& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        auto result = ::write(fd_, data.data() + done, data.size() - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            throw dal_error::FileError("Run file write failed.");
+        }
+        done += result;
+    }
+    offset_ += data.size();
+}
+
+SSTable::SSTable(const std::string& path, comparator::CustomFunction compare)
+    : path_(path)
+    , compare_(compare) {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw dal_error::FileError("Run file open failed.");
+    }
+    try {
+        struct stat file_stat{};
+        if (::fstat(fd_, &file_stat) != 0) {
+            throw dal_error::FileError("Run file stat failed.");
+        }
+        file_size_ = file_stat.st_size;
+        if (file_size_ < kFooterSize) {
+            throw dal_error::CorruptedBuffer("Run file is too short.");
+        }
+
+        auto footer = ReadAt(file_size_ - kFooterSize, kFooterSize);
+        if (memory::bytes_to_uint32(footer.data() + 44) != kMagic
+            || memory::bytes_to_uint32(footer.data() + 40) != memory::crc32(footer.data(), 40)) {
+            throw dal_error::CorruptedBuffer("Run file footer is corrupted.");
+        }
+        auto index_offset = memory::bytes_to_uint64(footer.data());
+        auto index_size = memory::bytes_to_uint64(footer.data() + 8);
+        auto filter_offset = memory::bytes_to_uint64(footer.data() + 16);
+        auto filter_size = memory::bytes_to_uint64(footer.data() + 24);
+        entries_ = memory::bytes_to_uint64(footer.data() + 32);
+
+        auto index = ReadAt(index_offset, index_size);
+        if (index.size() < kChecksumSize
+            || memory::crc32(index.data(), index.size() - kChecksumSize)
+                != memory::bytes_to_uint32(index.data() + index.size() - kChecksumSize)) {
+            throw dal_error::CorruptedBuffer("Run file index is corrupted.");
+        }
+        size_t offset = 0;
+        while (offset < index.size() - kChecksumSize) {
+            auto key_size = memory::bytes_to_uint32(index.data() + offset);
+            const byte* handle = index.data() + offset + 4;
+            index_.push_back({std::string(handle, key_size),
+                              memory::bytes_to_uint64(handle + key_size),
+                              memory::bytes_to_uint64(handle + key_size + 8)});
+            offset += 4 + key_size + 16;
+        }
+        filter_.emplace(ReadAt(filter_offset, filter_size));
+    } catch (...) {
+        ::close(fd_);
+        throw;
+    }
+}
+
+SSTable::~SSTable() {
+    ::close(fd_);
+    if (obsolete_) {
+        std::filesystem::remove(path_);
+    }
+}
+
+std::optional<SSTable::Record> SSTable::Find(std::string_view key) const {
+    if (!filter_->MayContain(key)) {
+        return std::nullopt;
+    }
+    // The first block, which last key is not less than the key
+    size_t left = 0;
+    size_t right = index_.size();
+    while (left < right) {
+        size_t middle = left + (right - left) / 2;
+        const auto& last_key = index_[middle].last_key;
+        if (compare_(last_key.data(), last_key.size(), key.data(), key.size()) < 0) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+    if (left == index_.size()) {
+        return std::nullopt;
+    }
+
+    auto block = ReadBlock(left);
+    size_t offset = 0;
+    while (offset < block.size()) {
+        const byte* record = block.data() + offset;
+        auto key_size = memory::bytes_to_uint32(record + 1);
+        auto value_size = memory::bytes_to_uint32(record + 5);
+        const byte* record_key = record + kRecordHeaderSize;
+        int comp_result = compare_(record_key, key_size, key.data(), key.size());
+        if (comp_result == 0) {
+            const byte* value = record_key + key_size;
+            return Record{static_cast<Log::Command>(record[0]), std::vector<byte>(value, value + value_size)};
+        }
+        if (comp_result > 0) {
+            break;
+        }
+        offset += kRecordHeaderSize + key_size + value_size;
+    }
+    return std::nullopt;
+}
+
+SSTable::Iterator SSTable::Begin() const {
+    return Iterator(this);
+}
+
+size_t SSTable::Size() const {
+    return entries_;
+}
+
+uint64_t SSTable::FileSize() const {
+    return file_size_;
+}
+
+const std::string& SSTable::GetPath() const {
+    return path_;
+}
+
+void SSTable::MarkObsolete() {
+    obsolete_ = true;
+}
+
+std::vector<byte> SSTable::ReadBlock(size_t index) const {
+    const auto& handle = index_[index];
+    auto block = ReadAt(handle.offset, handle.size);
+    if (block.size() < kChecksumSize
+        || memory::crc32(block.data(), block.size() - kChecksumSize)
+            != memory::bytes_to_uint32(block.data() + block.size() - kChecksumSize)) {
+        throw dal_error::CorruptedBuffer("Run file block is corrupted.");
+    }
+    block.resize(block.size() - kChecksumSize);
+    return block;
+}
+
+std::vector<byte> SSTable::ReadAt(uint64_t offset, uint64_t size) const {
+    if (offset + size > file_size_) {
+        throw dal_error::CorruptedBuffer("Run file part is out of file.");
+    }
+    std::vector<byte> buffer(size);
+    size_t done = 0;
+    while (done < size) {
+        auto result = ::pread(fd_, buffer.data() + done, size - done, static_cast<off_t>(offset + done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            throw dal_error::FileError("Run file read failed.");
+        }
+        done += result;
+    }
+    return buffer;
+}
+
+SSTable::Iterator::Iterator(const SSTable* table) : table_(table) {
+    if (!table_->index_.empty()) {
+        data_ = table_->ReadBlock(0);
+        Parse();
+    }
+}
+
+bool SSTable::Iterator::Valid() const {
+    return block_ < table_->index_.size();
+}
+
+void SSTable::Iterator::Next() {
+    offset_ += kRecordHeaderSize + key_.size() + value_.size();
+    if (offset_ >= data_.size()) {
+        ++block_;
+        offset_ = 0;
+        if (!Valid()) {
+            return;
+        }
+        data_ = table_->ReadBlock(block_);
+    }
+    Parse();
+}
+
+Log::Command SSTable::Iterator::Command() const {
+    return command_;
+}
+
+std::string_view SSTable::Iterator::Key() const {
+    return key_;
+}
+
+std::string_view SSTable::Iterator::Value() const {
+    return value_;
+}
+
+void SSTable::Iterator::Parse() {
+    const byte* record = data_.data() + offset_;
+    auto key_size = memory::bytes_to_uint32(record + 1);
+    auto value_size = memory::bytes_to_uint32(record + 5);
+    command_ = static_cast<Log::Command>(record[0]);
+    key_ = {record + kRecordHeaderSize, key_size};
+    value_ = {record + kRecordHeaderSize + key_size, value_size};
+}
@@ -0,0 +1,129 @@
+#ifndef SSTABLE_H_
+#define SSTABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log.h"
+
+#include "memory/type.h"
+#include "memory/bloom_filter.h"
+#include "memory/comparator.h"
+#include "exception/exception.h"
+
+// Sorted run file: [data blocks][index][filter][footer].
+// Data block is a list of [command][key size][value size][key][value] records with crc32 of the block
+// at the end. Index keeps the last key, offset and size of each block, filter is a bloom filter of all keys
+
+/// @brief Writes records, sorted by key, into a new run file
+class SSTableBuilder {
+public:
+    /// @param keys Expected number of records, the filter is sized for it
+    SSTableBuilder(const std::string& path, size_t keys, size_t bloom_bits_per_key);
+    /// @brief Removes the file, if it's not finished
+    ~SSTableBuilder();
+
+    SSTableBuilder(const SSTableBuilder&) = delete;
+    SSTableBuilder& operator=(const SSTableBuilder&) = delete;
+
+    /// @brief Appends record. Keys must be unique and ascending in table order
+    void Add(Log::Command command, std::string_view key, std::string_view value);
+    /// @brief Writes index, filter and footer and syncs the file
+    void Finish();
+
+private:
+    void FlushBlock();
+    void Write(const std::vector<byte>& data);
+
+    std::string path_;
+    int fd_ = -1;
+    bool finished_ = false;
+    uint64_t offset_ = 0;
+    uint64_t entries_ = 0;
+
+    std::vector<byte> block_;
+    std::string last_key_;
+    std::vector<byte> index_;
+    BloomFilter filter_;
+};
+
+/// @brief Immutable sorted run. Lookups are thread-safe
+class SSTable {
+public:
+    struct Record {
+        Log::Command command;
+        std::vector<byte> value;
+    };
+
+    /// @brief Reads records in key order, one block at a time
+    class Iterator {
+    public:
+        // Record views point into the block buffer, which is kept by moves, but not by copies
+        Iterator(Iterator&&) = default;
+        Iterator& operator=(Iterator&&) = default;
+
+        bool Valid() const;
+        void Next();
+        Log::Command Command() const;
+        std::string_view Key() const;
+        std::string_view Value() const;
+
+    private:
+        friend class SSTable;
+        explicit Iterator(const SSTable* table);
+        void Parse();
+
+        const SSTable* table_;
+        size_t block_ = 0;
+        std::vector<byte> data_;
+        size_t offset_ = 0;
+        Log::Command command_ = Log::Command::PUT;
+        std::string_view key_;
+        std::string_view value_;
+    };
+
+    SSTable(const std::string& path, comparator::CustomFunction compare);
+    /// @brief Closes the file and removes it, if it's obsolete
+    ~SSTable();
+
+    SSTable(const SSTable&) = delete;
+    SSTable& operator=(const SSTable&) = delete;
+
+    /// @return The record of the key or nullopt. Filter answers most of the misses without reads
+    std::optional<Record> Find(std::string_view key) const;
+    Iterator Begin() const;
+
+    size_t Size() const;
+    uint64_t FileSize() const;
+    const std::string& GetPath() const;
+    /// @brief File is removed, when the last reader drops the table
+    void MarkObsolete();
+
+    static constexpr size_t kBlockSize = 4096;
+
+private:
+    struct BlockHandle {
+        std::string last_key;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /// @brief Reads block and checks its checksum
+    std::vector<byte> ReadBlock(size_t index) const;
+    std::vector<byte> ReadAt(uint64_t offset, uint64_t size) const;
+
+    std::string path_;
+    comparator::CustomFunction compare_;
+    int fd_ = -1;
+    uint64_t file_size_ = 0;
+    uint64_t entries_ = 0;
+    std::vector<BlockHandle> index_;
+    std::optional<BloomFilter> filter_;
+    std::atomic<bool> obsolete_ = false;
+};
+
+#endif  // SSTABLE_H_
@@ -15,3 +15,9 @@ dal_error::CorruptedBuffer::CorruptedBuffer(const std::string& message)
 
 storage_error::InsertFailure::InsertFailure(const std::string& message)
     : std::runtime_error(message) {}
+
+storage_error::SettingsMismatch::SettingsMismatch(const std::string& message)
+    : std::runtime_error(message) {}
+
+storage_error::InvalidKey::InvalidKey(const std::string& message)
+    : std::runtime_error(message) {}
@@ -50,6 +50,22 @@ class InsertFailure : public std::runtime_error {
     std::string message_;
 };
 
+class InvalidKey : public std::runtime_error {
+   public:
+    InvalidKey(const std::string& message);
+
+   private:
+    std::string message_;
+};
+
+class SettingsMismatch : public std::runtime_error {
+   public:
+    SettingsMismatch(const std::string& message);
+
+   private:
+    std::string message_;
+};
+
 }  // namespace data_layer
 
 #endif  // EXCEPTION_H_ 
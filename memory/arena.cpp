@@ -0,0 +1,56 @@
+#include "arena.h"
+
+#include <cstddef>
+
+namespace {
+
+constexpr size_t kAlignment = alignof(std::max_align_t);
+
+}  // namespace
+
+Arena::Block::Block(size_t size) : data(new byte[size]), size(size) {}
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {
+    current_ = NewBlock(block_size_);
+}
+
+byte* Arena::Allocate(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    // Large allocations get own blocks, so they don't waste the rest of the current one
+    if (size > block_size_ / 4) {
+        std::unique_lock lock(mutex_);
+        memory_usage_.fetch_add(size, std::memory_order_relaxed);
+        return NewBlock(size)->data.get();
+    }
+
+    while (true) {
+        auto block = current_.load(std::memory_order_acquire);
+        auto offset = block->used.fetch_add(size, std::memory_order_relaxed);
+        if (offset + size <= block->size) {
+            memory_usage_.fetch_add(size, std::memory_order_relaxed);
+            return block->data.get() + offset;
+        }
+        // Block is exhausted. Only one of the racing threads replaces it
+        std::unique_lock lock(mutex_);
+        if (current_.load(std::memory_order_relaxed) == block) {
+            current_.store(NewBlock(block_size_), std::memory_order_release);
+        }
+    }
+}
+
+size_t Arena::MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+}
+
+size_t Arena::BlockOverhead() const {
+    // Counters are read separately, so the difference is approximate under concurrent allocations
+    auto reserved = reserved_.load(std::memory_order_relaxed);
+    auto usage = memory_usage_.load(std::memory_order_relaxed);
+    return reserved > usage ? reserved - usage : 0;
+}
+
+Arena::Block* Arena::NewBlock(size_t size) {
+    blocks_.push_back(std::make_unique<Block>(size));
+    reserved_.fetch_add(size, std::memory_order_relaxed);
+    return blocks_.back().get();
+}
@@ -0,0 +1,51 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "type.h"
+
+/// @brief Bump allocator. Memory is taken from large blocks and is freed all at once with the arena.
+/// Allocation is thread-safe, it only takes a lock, when the current block is exhausted
+class Arena {
+public:
+    static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+    explicit Arena(size_t block_size = kDefaultBlockSize);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// @brief Allocates memory aligned for any fundamental type
+    byte* Allocate(size_t size);
+
+    /// @return Bytes handed out by Allocate, including alignment padding
+    size_t MemoryUsage() const;
+    /// @return Bytes of blocks, that are taken from the system, but not allocated yet
+    size_t BlockOverhead() const;
+
+private:
+    struct Block {
+        explicit Block(size_t size);
+
+        std::unique_ptr<byte[]> data;
+        size_t size;
+        std::atomic<size_t> used = 0;
+    };
+
+    Block* NewBlock(size_t size);
+
+    const size_t block_size_;
+    std::atomic<Block*> current_;
+    std::atomic<size_t> memory_usage_ = 0;
+    std::atomic<size_t> reserved_ = 0;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Block>> blocks_;
+};
+
+#endif  // ARENA_H_
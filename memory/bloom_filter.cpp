@@ -0,0 +1,80 @@
+#include "bloom_filter.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+constexpr size_t kMinBits = 64;
+
+}  // namespace
+
+BloomFilter::BloomFilter(size_t keys, size_t bits_per_key) {
+    // k = ln(2) * bits per key minimizes false positives
+    probes_ = std::clamp(static_cast<int>(bits_per_key * 69 / 100), 1, 30);
+    bits_ = std::max(keys * bits_per_key, kMinBits);
+    bits_ = (bits_ + 7) / 8 * 8;
+    data_.assign(bits_ / 8 + 1, 0);
+    data_.back() = static_cast<byte>(probes_);
+}
+
+BloomFilter::BloomFilter(std::vector<byte> data) : data_(std::move(data)) {
+    if (data_.size() < 2) {
+        // Degenerate filter matches everything
+        data_.assign(1, 0);
+        return;
+    }
+    bits_ = (data_.size() - 1) * 8;
+    probes_ = static_cast<uint8_t>(data_.back());
+}
+
+void BloomFilter::Add(std::string_view key) {
+    // Double hashing: probes are h1 + i * h2
+    uint64_t hash = Hash(key);
+    uint32_t delta = static_cast<uint32_t>(hash >> 32) | 1;
+    uint32_t position = static_cast<uint32_t>(hash);
+    for (int i = 0; i < probes_; ++i) {
+        size_t bit = position % bits_;
+        std::atomic_ref<byte>(data_[bit / 8]).fetch_or(static_cast<byte>(1 << (bit % 8)),
+                                                       std::memory_order_relaxed);
+        position += delta;
+    }
+}
+
+bool BloomFilter::MayContain(std::string_view key) const {
+    if (bits_ == 0 || probes_ == 0) {
+        return true;
+    }
+    uint64_t hash = Hash(key);
+    uint32_t delta = static_cast<uint32_t>(hash >> 32) | 1;
+    uint32_t position = static_cast<uint32_t>(hash);
+    for (int i = 0; i < probes_; ++i) {
+        size_t bit = position % bits_;
+        // Bits are only set, never changed otherwise, so the const byte is safe to access atomically
+        auto bits = std::atomic_ref<byte>(const_cast<byte&>(data_[bit / 8])).load(std::memory_order_relaxed);
+        if ((bits & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+        position += delta;
+    }
+    return true;
+}
+
+const std::vector<byte>& BloomFilter::Data() const {
+    return data_;
+}
+
+uint64_t BloomFilter::Hash(std::string_view key) {
+    // FNV-1a with a final avalanche, so both halves are usable as separate hashes
+    uint64_t hash = 14695981039346656037ull;
+    for (auto symbol : key) {
+        hash ^= static_cast<uint8_t>(symbol);
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
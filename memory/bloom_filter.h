@@ -0,0 +1,34 @@
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "type.h"
+
+/// @brief Set of keys with false positives and no false negatives.
+/// Serialized form is the bit array with the number of probes in the last byte.
+/// Bits are accessed atomically, so lookups may run concurrently with a single writer
+class BloomFilter {
+public:
+    /// @param keys Expected number of keys
+    /// @param bits_per_key False positive rate is about 0.6185 ^ bits_per_key
+    BloomFilter(size_t keys, size_t bits_per_key);
+    /// @brief Restores filter from its serialized form
+    explicit BloomFilter(std::vector<byte> data);
+
+    void Add(std::string_view key);
+    bool MayContain(std::string_view key) const;
+
+    const std::vector<byte>& Data() const;
+
+private:
+    static uint64_t Hash(std::string_view key);
+
+    std::vector<byte> data_;
+    size_t bits_ = 0;
+    int probes_ = 0;
+};
+
+#endif  // BLOOM_FILTER_H_
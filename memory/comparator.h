@@ -0,0 +1,102 @@
+#ifndef COMPARATOR_H_
+#define COMPARATOR_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#include "type.h"
+
+namespace comparator {
+
+// Stored in table meta, values must not be changed
+enum class Type : uint64_t {
+    kBytewise = 0,
+    kReverseBytewise = 1,
+    kUInt64 = 2,
+    kCustom = 3
+};
+
+using CustomFunction = int (*)(const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size);
+
+// Lexicographical order of unsigned bytes. Prefix is less than the key itself
+struct Bytewise {
+    int operator()(const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) const {
+        int comp_result = std::memcmp(lhs, rhs, std::min(lhs_size, rhs_size));
+        if (comp_result != 0 || lhs_size == rhs_size) {
+            return comp_result;
+        }
+        return lhs_size < rhs_size ? -1 : 1;
+    }
+};
+
+struct ReverseBytewise {
+    int operator()(const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) const {
+        return Bytewise()(rhs, rhs_size, lhs, lhs_size);
+    }
+};
+
+// Numeric order of little-endian unsigned integers. Keys are expected to be 8 bytes long,
+// shorter ones are zero extended, longer ones are ordered by the first 8 bytes and then by tail
+struct UInt64 {
+    static uint64_t ToUInt64(const byte* data, size_t size) {
+        uint64_t value = 0;
+        size = std::min(size, sizeof(uint64_t));
+        if constexpr (std::endian::native == std::endian::little) {
+            std::memcpy(&value, data, size);
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+            }
+        }
+        return value;
+    }
+
+    int operator()(const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) const {
+        uint64_t lhs_value = ToUInt64(lhs, lhs_size);
+        uint64_t rhs_value = ToUInt64(rhs, rhs_size);
+        if (lhs_value != rhs_value) {
+            return lhs_value < rhs_value ? -1 : 1;
+        }
+        if (lhs_size <= sizeof(uint64_t) && rhs_size <= sizeof(uint64_t)) {
+            return lhs_size == rhs_size ? 0 : (lhs_size < rhs_size ? -1 : 1);
+        }
+        auto tail = [](size_t size) { return size > sizeof(uint64_t) ? size - sizeof(uint64_t) : 0; };
+        return Bytewise()(lhs + std::min(lhs_size, sizeof(uint64_t)), tail(lhs_size),
+                          rhs + std::min(rhs_size, sizeof(uint64_t)), tail(rhs_size));
+    }
+};
+
+// User-supplied order. The only policy, which is called through a pointer
+struct Custom {
+    CustomFunction function;
+
+    int operator()(const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) const {
+        return function(lhs, lhs_size, rhs, rhs_size);
+    }
+};
+
+// Plain function of the order, for containers that are not specialized on the policy
+inline CustomFunction GetFunction(Type type, CustomFunction custom) {
+    switch (type) {
+        case Type::kReverseBytewise:
+            return [](const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) {
+                return ReverseBytewise()(lhs, lhs_size, rhs, rhs_size);
+            };
+        case Type::kUInt64:
+            return [](const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) {
+                return UInt64()(lhs, lhs_size, rhs, rhs_size);
+            };
+        case Type::kCustom:
+            return custom;
+        default:
+            return [](const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) {
+                return Bytewise()(lhs, lhs_size, rhs, rhs_size);
+            };
+    }
+}
+
+}  // namespace comparator
+
+#endif  // COMPARATOR_H_
@@ -1,5 +1,7 @@
 #include "memory.h"
 
+#include <array>
+
 void memory::uint16_to_bytes(byte* dest, uint16_t value) {
     if constexpr (std::endian::native == std::endian::little) {
         std::memcpy(dest, reinterpret_cast<char*>(&value), 2);
@@ -21,6 +23,31 @@ uint16_t memory::bytes_to_uint16(const byte* src) {
     return value;
 }
 
+void memory::uint32_to_bytes(byte* dest, uint32_t value) {
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(dest, reinterpret_cast<char*>(&value), 4);
+    } else {
+        dest[0] = static_cast<char>(value);
+        dest[1] = static_cast<char>(value >> 8);
+        dest[2] = static_cast<char>(value >> 16);
+        dest[3] = static_cast<char>(value >> 24);
+    }
+}
+
+uint32_t memory::bytes_to_uint32(const byte* src) {
+    uint32_t value = 0;
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(reinterpret_cast<char*>(&value), src, 4);
+    } else {
+        value += (uint32_t)(uint8_t)src[0];
+        value += (uint32_t)(uint8_t)src[1] << 8;
+        value += (uint32_t)(uint8_t)src[2] << 16;
+        value += (uint32_t)(uint8_t)src[3] << 24;
+    }
+
+    return value;
+}
+
 void memory::uint64_to_bytes(byte* dest, uint64_t value) {
     if constexpr (std::endian::native == std::endian::little) {
         std::memcpy(dest, reinterpret_cast<char*>(&value), 8);
@@ -53,3 +80,28 @@ uint64_t memory::bytes_to_uint64(const byte* src) {
 
     return value;
 }
+
+namespace {
+
+std::array<uint32_t, 256> MakeCrc32Table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+}  // namespace
+
+uint32_t memory::crc32(const byte* data, size_t size) {
+    static const auto table = MakeCrc32Table();
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
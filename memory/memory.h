@@ -9,7 +9,13 @@ namespace memory {
 void uint16_to_bytes(byte* dest, uint16_t value);
 uint16_t bytes_to_uint16(const byte* src);
 
+void uint32_to_bytes(byte* dest, uint32_t value);
+uint32_t bytes_to_uint32(const byte* src);
+
 void uint64_to_bytes(byte* dest, uint64_t value);
 uint64_t bytes_to_uint64(const byte* src);
 
+// CRC-32 (IEEE 802.3), as in zlib
+uint32_t crc32(const byte* data, size_t size);
+
 }  // namespace convert
@@ -5,7 +5,8 @@ using namespace AnilopDB;
 std::shared_ptr<DB> DB::db;
 
 std::shared_ptr<DB> DB::Open(const std::unordered_map<std::string, std::string>& code_path_map,
-                             const AnilopDB::Settings &settings) {
+                             const AnilopDB::Settings &settings,
+                             const std::unordered_map<std::string, Settings>& table_settings) {
     if (!db) {
         db = std::shared_ptr<DB>(new DB());
     }
@@ -14,26 +15,26 @@ std::shared_ptr<DB> DB::Open(const std::unordered_map<std::string, std::string>&
         if (db->table_map_.contains(code))
             continue;
 
-        db->table_map_[code] = std::shared_ptr<Table>(new Table(code, path, settings));
+        auto settings_it = table_settings.find(code);
+        const auto& code_settings = settings_it != table_settings.end() ? settings_it->second : settings;
+        db->table_map_[code] = std::shared_ptr<Table>(new Table(code, path, code_settings));
     }
     return db;
 }
 
 std::shared_ptr<Transaction> DB::newReadTx(const std::vector<std::string>& codes) {
+    // Read transaction takes snapshots of the tables instead of their locks
     auto tx_tables = getTxTables(codes);
-    for (auto table : tx_tables) {
-        table->tx_mutex_.lock_shared();
-    }
-
     return std::shared_ptr<Transaction>(new Transaction(false , tx_tables));
 }
 
-std::shared_ptr<Transaction> DB::newWriteTx(const std::vector<std::string>& codes) {
+std::shared_ptr<Transaction> DB::newWriteTx(const std::vector<std::string>& codes,
+                                            std::optional<Durability> durability) {
     auto tx_tables = getTxTables(codes);
     for (auto table : tx_tables) {
         table->tx_mutex_.lock();
     }
-    return std::shared_ptr<Transaction>(new Transaction(true, tx_tables));
+    return std::shared_ptr<Transaction>(new Transaction(true, tx_tables, durability));
 }
 
 std::vector<std::shared_ptr<Table>> DB::getTxTables(const std::vector<std::string> &codes) {
@@ -83,6 +84,18 @@ void DB::Remove(const std::string &code, const std::string &key) {
     Remove(code, AnilopDB::StringToData(key));
 }
 
+std::optional<Data> DB::Find(const std::string &code, uint64_t key) {
+    return Find(code, AnilopDB::UInt64ToData(key));
+}
+
+void DB::Put(const std::string &code, uint64_t key, const Data &data) {
+    Put(code, AnilopDB::UInt64ToData(key), data);
+}
+
+void DB::Remove(const std::string &code, uint64_t key) {
+    Remove(code, AnilopDB::UInt64ToData(key));
+}
+
 void DB::Close() {
     for (auto [_, table] : table_map_) {
         table->Close();
@@ -17,8 +17,10 @@ namespace AnilopDB {
 
     class DB {
     public:
+        /// @param table_settings Overrides settings for listed table codes
         static std::shared_ptr<DB> Open(const std::unordered_map<std::string, std::string>& code_path_map,
-                                        const Settings& settings);
+                                        const Settings& settings,
+                                        const std::unordered_map<std::string, Settings>& table_settings = {});
 
         std::optional<Data> Find(const std::string& code, const Data &key);
         void Put(const std::string& code, const Data &key, const Data &data);
@@ -28,8 +30,14 @@ namespace AnilopDB {
         void Put(const std::string& code, const std::string&key, const std::string& data);
         void Remove(const std::string& code, const std::string& key);
 
+        std::optional<Data> Find(const std::string& code, uint64_t key);
+        void Put(const std::string& code, uint64_t key, const Data &data);
+        void Remove(const std::string& code, uint64_t key);
+
         std::shared_ptr<Transaction> newReadTx(const std::vector<std::string>& codes);
-        std::shared_ptr<Transaction> newWriteTx(const std::vector<std::string>& codes);
+        /// @param durability Overrides durability of the tables for this transaction
+        std::shared_ptr<Transaction> newWriteTx(const std::vector<std::string>& codes,
+                                                std::optional<Durability> durability = std::nullopt);
 
         void Close();
 
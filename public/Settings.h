@@ -1,12 +1,74 @@
 #ifndef ANILOP_SETTINGS_H
 #define ANILOP_SETTINGS_H
 
+#include <string>
+
 #include "memory/type.h"
 
 namespace AnilopDB {
 
+    enum class KeyOrder {
+        kBytewise,
+        kReverseBytewise,
+        // Keys are 8 byte little-endian unsigned integers
+        kUInt64,
+        // Order is defined by Settings::custom_comparator
+        kCustom
+    };
+
+    enum class KeyType {
+        kBytes,
+        // 8 byte integer keys, ordered numerically. Nodes keep them packed
+        kUInt64
+    };
+
+    enum class Engine {
+        // Memtable is merged into the B-tree
+        kBTree,
+        // Memtable is written as sorted runs, which are merged by background compaction
+        kLsm
+    };
+
+    enum class Durability {
+        // Commit returns after its log is synced to disk
+        kSync,
+        // Commit waits for the next periodic sync, that is shared by all commits of the interval
+        kGroup,
+        // Commit returns at once. Commits of the last sync_interval_us can be lost on a crash
+        kAsync
+    };
+
+    // Returns negative, zero or positive value, like memcmp
+    using KeyComparator = int (*)(const char* lhs, size_t lhs_size, const char* rhs, size_t rhs_size);
+
     struct Settings {
-        size_t max_log_size = 100;
+        // Memtable size in bytes, at which it's flushed into the tree in background. At least 64 KiB
+        size_t memtable_size = 1 << 20;
+        // Writers wait for the flush above this size. 0 means twice memtable_size
+        size_t memtable_hard_limit = 0;
+        // Tree is updated by shadow paging instead of undo log and in place writes
+        bool copy_on_write = false;
+        // Underpopulated nodes are merged in background instead of on every remove
+        bool lazy_rebalance = false;
+        // Key order is fixed on table creation
+        KeyOrder key_order = KeyOrder::kBytewise;
+        KeyComparator custom_comparator = nullptr;
+        // Name of the custom comparator. It's recorded on table creation and checked on open
+        std::string custom_comparator_name;
+        // Key type is fixed on table creation. kUInt64 implies KeyOrder::kUInt64
+        KeyType key_type = KeyType::kBytes;
+        // Storage engine is fixed on table creation
+        Engine engine = Engine::kBTree;
+        // Tree pages, kept in memory between checkpoints. Commits only append to the log,
+        // pages are written back in background
+        size_t buffer_pool_pages = 256;
+        // Bloom filter bits per key, that let lookups of absent keys skip the tree and sorted runs.
+        // 10 bits give about 1% of false positives, 0 disables the tree filter
+        size_t bloom_bits_per_key = 10;
+        // Default durability of commits to the table. Write transaction can override it
+        Durability durability = Durability::kSync;
+        // Period of the log sync for kGroup and kAsync durability in microseconds
+        size_t sync_interval_us = 2000;
     };
 
 }
@@ -1,5 +1,8 @@
 #include "Table.h"
 
+#include <algorithm>
+
+#include "memory/arena.h"
 #include "settings/settings.h"
 #include "storage/storage.h"
 
@@ -16,7 +19,24 @@ Table::Table(const std::string& code, const std::string& path, const Settings &s
     : code_(code)
     , path_(path) {
     settings::UserSettings user_settings;
-    user_settings.max_log_size = settings.max_log_size;
+    // Smaller memtable would be flushed after a few records
+    auto memtable_size = std::max(settings.memtable_size, Arena::kDefaultBlockSize);
+    user_settings.memtable_soft_limit = memtable_size;
+    user_settings.memtable_hard_limit = std::max(memtable_size,
+        settings.memtable_hard_limit != 0 ? settings.memtable_hard_limit : 2 * memtable_size);
+    user_settings.copy_on_write = settings.copy_on_write;
+    user_settings.lazy_rebalance = settings.lazy_rebalance;
+    // KeyOrder values match comparator::Type
+    user_settings.comparator = static_cast<comparator::Type>(settings.key_order);
+    user_settings.custom_comparator = settings.custom_comparator;
+    user_settings.custom_comparator_name = settings.custom_comparator_name;
+    user_settings.uint64_keys = settings.key_type == KeyType::kUInt64;
+    user_settings.engine = settings.engine == Engine::kLsm ? settings::Engine::kLsm : settings::Engine::kBTree;
+    user_settings.bloom_bits_per_key = settings.bloom_bits_per_key;
+    user_settings.buffer_pool_pages = settings.buffer_pool_pages;
+    // Durability values match settings::Durability
+    user_settings.durability = static_cast<settings::Durability>(settings.durability);
+    user_settings.sync_interval_us = std::max<size_t>(settings.sync_interval_us, 1);
 
     storage_ = std::make_shared<Storage>(path, user_settings);
 }
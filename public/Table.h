@@ -36,6 +36,7 @@ namespace AnilopDB {
         std::string code_;
         std::string path_;
         std::shared_ptr<Storage> storage_;
+        // Serializes write transactions. Read ones read from snapshots
         std::shared_mutex tx_mutex_;
     };
 
@@ -6,9 +6,14 @@
 using namespace AnilopDB;
 
 Transaction::Transaction(bool is_write,
-                         const std::vector<std::shared_ptr<Table>>& tables) {
+                         const std::vector<std::shared_ptr<Table>>& tables,
+                         std::optional<Durability> durability) {
+    std::optional<settings::Durability> tx_durability;
+    if (durability.has_value()) {
+        tx_durability = static_cast<settings::Durability>(*durability);
+    }
     for (const auto& table : tables) {
-        impls_.push_back(new TransactionImpl(is_write, table->storage_, table->tx_mutex_));
+        impls_.push_back(new TransactionImpl(is_write, table->storage_, table->tx_mutex_, tx_durability));
         code_impl_[table->code_] = impls_.back();
     }
 }
@@ -51,6 +56,18 @@ void Transaction::Remove(const std::string& code, const std::string &key) {
     Remove(code, AnilopDB::StringToData(key));
 }
 
+std::optional<Data> Transaction::Find(const std::string& code, uint64_t key) {
+    return Find(code, AnilopDB::UInt64ToData(key));
+}
+
+void Transaction::Put(const std::string& code, uint64_t key, const Data &data) {
+    Put(code, AnilopDB::UInt64ToData(key), data);
+}
+
+void Transaction::Remove(const std::string& code, uint64_t key) {
+    Remove(code, AnilopDB::UInt64ToData(key));
+}
+
 void Transaction::commit() {
     for (auto impl : std::ranges::reverse_view(impls_)) {
         impl->commit();
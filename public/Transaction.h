@@ -6,6 +6,7 @@
 #include <shared_mutex>
 #include <unordered_map>
 
+#include "Settings.h"
 #include "Table.h"
 #include "type.h"
 
@@ -34,6 +35,10 @@ namespace AnilopDB {
         void Put(const std::string& code, const std::string& key, const std::string& data);
         void Remove(const std::string& code, const std::string& key);
 
+        std::optional<Data> Find(const std::string& code, uint64_t key);
+        void Put(const std::string& code, uint64_t key, const Data &data);
+        void Remove(const std::string& code, uint64_t key);
+
         void commit();
 
         void rollback();
@@ -41,7 +46,8 @@ namespace AnilopDB {
         ~Transaction();
 
     private:
-        Transaction(bool is_write, const std::vector<std::shared_ptr<Table>>& tables);
+        Transaction(bool is_write, const std::vector<std::shared_ptr<Table>>& tables,
+                    std::optional<Durability> durability = std::nullopt);
 
         std::unordered_map<std::string, TransactionImpl*> code_impl_;
         // Order is important
@@ -16,4 +16,12 @@ namespace AnilopDB {
         return result;
     }
 
+    Data UInt64ToData(uint64_t value) {
+        Data result(sizeof(uint64_t));
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = static_cast<byte>(value >> (8 * i));
+        }
+        return result;
+    }
+
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef ANILOP_TYPE_H_
 #define ANILOP_TYPE_H_
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -12,6 +13,9 @@ namespace AnilopDB {
     std::string DataToString(const Data &data);
     Data StringToData(const std::string &str);
 
+    // Little-endian key of integer keys table
+    Data UInt64ToData(uint64_t value);
+
 }
 
 #endif // ANILOP_TYPE_H_
@@ -2,17 +2,70 @@
 #define SETTINGS_H_
 
 #include "memory/type.h"
+#include "memory/comparator.h"
 #include <cstdint>
+#include <string>
 
 namespace settings {
 
 extern const size_t kMaxPage;
 extern const size_t kPageSize;
 
+// Stored in table meta, values must not be changed
+enum class Engine : uint64_t {
+    // Memtable is merged into the B-tree in place
+    kBTree = 0,
+    // Memtable is written as sorted runs, which are merged by compaction
+    kLsm = 1
+};
+
+// How a commit waits for its log. Not stored, can be changed on every open
+enum class Durability {
+    // Commit waits for a sync of its log. Concurrent commits share the sync
+    kSync,
+    // Commit waits for the next periodic sync
+    kGroup,
+    // Commit doesn't wait. Logs are synced periodically, commits of the last interval can be lost on a crash
+    kAsync
+};
+
 struct UserSettings {
-    size_t max_log_size = 100;
+    // Memtable flush into the tree is started in background at the soft limit in bytes.
+    // Writers stall at the hard limit, until the flush is finished. Limits are at least one arena block
+    size_t memtable_soft_limit = 1 << 20;
+    size_t memtable_hard_limit = 2 << 20;
+    // Size of preallocated log segment files
+    size_t log_segment_size = 1 << 20;
+    Durability durability = Durability::kSync;
+    // Period of the log sync for kGroup and kAsync durability
+    size_t sync_interval_us = 2000;
     double min_fill_percent = 0.2;
     double max_fill_percent = 0.95;
+    // Key order. It's recorded on table creation and can't be changed later
+    comparator::Type comparator = comparator::Type::kBytewise;
+    comparator::CustomFunction custom_comparator = nullptr;
+    // Identifies custom comparator, as the function itself can't be recorded
+    std::string custom_comparator_name;
+    // Keys are 8 byte integers, stored packed in nodes. Forces kUInt64 comparator
+    bool uint64_keys = false;
+    // Write modified nodes to fresh pages and publish new root instead of in place updates
+    bool copy_on_write = false;
+    // Tolerate underpopulated nodes on remove and merge them in a background pass
+    bool lazy_rebalance = false;
+    // Number of deferred nodes, that triggers the background pass
+    size_t max_deferred_rebalance = 64;
+    // Storage engine. It's recorded on table creation and can't be changed later
+    Engine engine = Engine::kBTree;
+    // Number of level 0 runs, that triggers their compaction into level 1
+    size_t lsm_level0_runs = 4;
+    // Size of level 1 run in bytes, each next level is lsm_level_ratio times larger
+    size_t lsm_level_size = 8 << 20;
+    size_t lsm_level_ratio = 10;
+    // Pages, buffered between checkpoints. Merge of a memtable is checkpointed, when it's reached
+    size_t buffer_pool_pages = 256;
+    // Bloom filter size of a run and of the tree. 10 bits give about 1% of false positives.
+    // 0 disables the tree filter
+    size_t bloom_bits_per_key = 10;
 };
 
 }  // namespace settings
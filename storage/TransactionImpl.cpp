@@ -6,11 +6,16 @@
 TransactionImpl::TransactionImpl(
         bool is_write,
         std::shared_ptr<Storage> storage,
-        std::shared_mutex& mutex
+        std::shared_mutex& mutex,
+        std::optional<settings::Durability> durability
 )
 : is_write_(is_write)
 , mutex_(mutex)
+, durability_(durability)
 , storage_(std::move(storage)) {
+    if (!is_write_) {
+        snapshot_ = storage_->GetSnapshot();
+    }
 }
 
 std::optional<Data> TransactionImpl::Find(const Data &key) {
@@ -22,12 +27,15 @@ std::optional<Data> TransactionImpl::Find(const Data &key) {
         else
             return std::make_optional(map_it->second.back()->GetValue());
     }
+    if (snapshot_ != nullptr) {
+        return storage_->Find(key, *snapshot_);
+    }
     return storage_->Find(key);
 }
 
 void TransactionImpl::rollback() {
     if (!is_write_) {
-        mutex_.unlock_shared();
+        snapshot_.reset();
         return;
     }
 
@@ -38,11 +46,11 @@ void TransactionImpl::rollback() {
 
 void TransactionImpl::commit() {
     if (!is_write_) {
-        mutex_.unlock_shared();
+        snapshot_.reset();
         return;
     }
 
-    storage_->PushTransactionLogs(memory_tx_log_);
+    storage_->PushTransactionLogs(memory_tx_log_, durability_);
 
     memory_tx_log_.clear();
     key_to_tx_memory_log_.clear();
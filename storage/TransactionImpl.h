@@ -13,7 +13,8 @@ public:
     TransactionImpl(
             bool is_write,
             std::shared_ptr<Storage> storage_,
-            std::shared_mutex& mutex
+            std::shared_mutex& mutex,
+            std::optional<settings::Durability> durability = std::nullopt
     );
 
     std::optional<Data> Find(const Data &key);
@@ -28,7 +29,12 @@ public:
 
 private:
     bool is_write_;
+    // Taken only by write transactions
     std::shared_mutex& mutex_;
+    // Read transaction sees the table as it was at the start and never blocks writers
+    std::shared_ptr<const Storage::Snapshot> snapshot_;
+    // Overrides durability of the table
+    std::optional<settings::Durability> durability_;
 
     std::shared_ptr<Storage> storage_;
 
@@ -1,82 +1,65 @@
 #include "log_storage.h"
 
-LogStorage::LogStorage(std::shared_ptr<DAL> dal, std::shared_ptr<LogDAL> log_dal, const settings::UserSettings &settings)
-    : settings_(settings), dal_(std::move(dal)), log_dal_(std::move(log_dal)) {
-    auto log_buffer = log_dal_->ReadLogBuffer();
-    auto log_buffer_ptr = log_buffer.data();
-    uint64_t buffer_size_left = log_buffer.size();
-
-    size_t start_count = 0;
-    size_t commit_count = 0;
-    while (buffer_size_left > 0) {
-        auto log = Log::readFromBuffer(log_buffer_ptr, buffer_size_left);
-        log_buffer_ptr += log.GetByteLength();
-        buffer_size_left -= log.GetByteLength();
-
-        if (log.GetCommand() == Log::Command::START)
-            start_count++;
-        if (log.GetCommand() == Log::Command::COMMIT)
-            commit_count++;
-        WriteLogToMemory(log);
-    }
+namespace {
 
-    auto log_index = memory_log_.size() - 1;
-    uint64_t clear_offset = 0;
-    while (log_index > 0 && commit_count != start_count) {
-        auto log_it = memory_log_.begin();
-        std::advance(log_it, log_index);
-
-        auto log = *log_it;
-        if (log.GetCommand() == Log::Command::START)
-            --start_count;
-        if (log.GetCommand() == Log::Command::COMMIT)
-            --commit_count;
+std::string_view View(const std::vector<byte>& data) {
+    return {data.data(), data.size()};
+}
 
-        clear_offset += log.GetByteLength();
+}  // namespace
 
-        auto str_key = ConvertToStr(log.GetKey());
-        key_to_memory_log_[str_key].pop_back();
+LogStorage::LogStorage(std::shared_ptr<DAL> dal, std::shared_ptr<LogDAL> log_dal, const settings::UserSettings &settings)
+    : settings_(settings), dal_(std::move(dal)), log_dal_(std::move(log_dal)) {
+    mem_table_ = std::make_shared<MemTable>(comparator::GetFunction(settings_.comparator, settings_.custom_comparator));
+
+    // Log is replayed in a single pass straight into memtable. Transaction is a single frame,
+    // so a torn one is dropped by the log scan as a whole
+    log_dal_->Replay([&](uint64_t sequence, const byte* payload, size_t size) {
+        auto log = Log::ReadView(payload, size);
+        mem_table_->Add(sequence, log.command, log.key, log.value);
+    });
+    visible_sequence_ = log_dal_->GetLastSequence();
+}
 
-        memory_log_.erase(log_it);
-        --log_index;
+std::optional<std::vector<byte>> LogStorage::Find(const std::vector<byte> &key, bool* removed,
+                                                  uint64_t sequence) const {
+    auto entry = mem_table_->Find(View(key), sequence);
+    if (!entry.has_value() && immutable_ != nullptr) {
+        entry = immutable_->Find(View(key), sequence);
     }
-    if (clear_offset > 0) {
-        log_dal_->ClearLatest(clear_offset);
+    if (removed != nullptr) {
+        *removed = entry.has_value() && entry->command == Log::Command::REMOVE;
     }
-}
-
-std::optional<std::vector<byte>> LogStorage::Find(const std::vector<byte> &key) {
-    auto str_key = ConvertToStr(key);
-    auto map_it = key_to_memory_log_.find(str_key);
-    if (map_it != key_to_memory_log_.end()) {
-        const auto& log = map_it->second.back();
-        if (log->GetCommand() != Log::Command::REMOVE)
-            return std::make_optional(map_it->second.back()->GetValue());
+    if (entry.has_value() && entry->command == Log::Command::PUT) {
+        return std::vector<byte>(entry->value.begin(), entry->value.end());
     }
     return std::nullopt;
 }
 
-bool LogStorage::Put(const std::vector<byte>& key, const std::vector<byte>& value) {
-    if (!dal_->CanWrite() || memory_log_.size() >= settings_.max_log_size) {
-        return false;
+std::optional<uint64_t> LogStorage::Put(const std::vector<byte>& key, const std::vector<byte>& value) {
+    if (!CanWrite()) {
+        return std::nullopt;
     }
-    Log log(Log::Command::PUT, key, value);
-    auto str_key = ConvertToStr(key);
-
-    WriteLog(log);
-    return true;
+    return WriteLog({ Log::Command::PUT, View(key), View(value) });
 }
 
-bool LogStorage::Remove(const std::vector<byte> &key) {
-    Log log(Log::Command::REMOVE, key);
-    auto str_key = ConvertToStr(key);
+std::optional<uint64_t> LogStorage::Remove(const std::vector<byte> &key) {
+    if (!CanWrite()) {
+        return std::nullopt;
+    }
+    return WriteLog({ Log::Command::REMOVE, View(key), {} });
+}
 
-    WriteLog(log);
-    return true;
+bool LogStorage::CanWrite() const {
+    return dal_->CanWrite() && mem_table_->MemoryUsage() < settings_.memtable_hard_limit;
 }
 
 size_t LogStorage::Size() {
-    return memory_log_.size();
+    return mem_table_->Size();
+}
+
+size_t LogStorage::MemoryUsage() const {
+    return mem_table_->MemoryUsage();
 }
 
 std::string LogStorage::ConvertToStr(const std::vector<byte> &data) {
@@ -90,40 +73,65 @@ std::vector<byte> LogStorage::ConvertFromStr(const std::string &data) {
     return { data.begin(), std::prev(data.end()) };
 }
 
-std::list<Log> &LogStorage::GetLogs() {
-    return memory_log_;
+const MemTable& LogStorage::GetMemTable() const {
+    return *mem_table_;
 }
 
-const std::list<Log> &LogStorage::GetLogs() const {
-    return memory_log_;
+std::shared_ptr<const MemTable> LogStorage::GetImmutable() const {
+    return immutable_;
 }
 
-void LogStorage::Clear() {
-    memory_log_.clear();
-    key_to_memory_log_.clear();
+uint64_t LogStorage::GetVisibleSequence() const {
+    std::unique_lock lock(visible_mutex_);
+    return visible_sequence_;
+}
 
-    log_dal_->ClearLogs();
+void LogStorage::Publish(uint64_t first, uint64_t last) {
+    // Sequences after a failed write fail too, so there is no gap to wait for
+    std::unique_lock lock(visible_mutex_);
+    visible_cv_.wait(lock, [this, first]() { return visible_sequence_ + 1 >= first; });
+    visible_sequence_ = std::max(visible_sequence_, last);
+    visible_cv_.notify_all();
 }
 
-void LogStorage::PushTransactionLogs(const std::vector<Log> &logs) {
-    WriteLog({ Log::Command::START });
-    for (const auto& log : logs)
-        WriteLog(log);
-    WriteLog({ Log::Command::COMMIT });
+void LogStorage::Freeze() {
+    immutable_ = std::move(mem_table_);
+    mem_table_ = std::make_shared<MemTable>(comparator::GetFunction(settings_.comparator, settings_.custom_comparator));
+    // Logs of the fresh memtable start in another segment, so the frozen ones are released on their own
+    immutable_end_ = log_dal_->Rotate();
 }
 
-void LogStorage::WriteLog(const Log &log) {
-    log_dal_->WriteLog(log);
-    WriteLogToMemory(log);
+LogDAL::Checkpoint LogStorage::DropImmutable() {
+    immutable_.reset();
+    return immutable_end_;
 }
 
-void LogStorage::WriteLogToMemory(const Log &log) {
-    memory_log_.push_back(log);
+uint64_t LogStorage::PushTransactionLogs(const std::vector<Log> &logs,
+                                         std::optional<settings::Durability> durability) {
+    if (logs.empty()) {
+        return 0;
+    }
+    // Transaction is one frame, written and synced at once
+    auto sequence = log_dal_->AppendBatch(logs);
+    // Records are visible only after the whole transaction is durable, unless commit is asynchronous
+    log_dal_->WaitDurable(sequence, durability.value_or(settings_.durability));
+    auto first = sequence + 1 - logs.size();
+    for (size_t i = 0; i < logs.size(); ++i)
+        WriteLogToMemory(first + i, logs[i]);
+    Publish(first, sequence);
+    return sequence;
+}
 
-    if (log.GetCommand() == Log::Command::START
-        || log.GetCommand() == Log::Command::COMMIT)
-        return;
+uint64_t LogStorage::WriteLog(const Log::View &log) {
+    // Record is serialized from the caller buffers into the log queue and copied once more into memtable.
+    // Failed write leaves memtable untouched, so readers never see a record, that can be lost
+    auto sequence = log_dal_->Append(log);
+    log_dal_->WaitDurable(sequence);
+    mem_table_->Add(sequence, log.command, log.key, log.value);
+    Publish(sequence, sequence);
+    return sequence;
+}
 
-    auto str_key = ConvertToStr(log.GetKey());
-    key_to_memory_log_[str_key].push_back(std::prev(memory_log_.end()));
+void LogStorage::WriteLogToMemory(uint64_t sequence, const Log &log) {
+    mem_table_->Add(sequence, log.GetCommand(), View(log.GetKey()), View(log.GetValue()));
 }
@@ -2,47 +2,81 @@
 #define LOG_STORAGE_H_
 
 #include <optional>
-#include <unordered_map>
-#include <list>
+#include <condition_variable>
 #include <cstring>
+#include <limits>
 #include <memory>
-#include <tuple>
+#include <mutex>
+#include <string_view>
 
 #include "dal/dal.h"
 #include "dal/log_dal.h"
 #include "dal/log.h"
 #include "memory/type.h"
 #include "settings/settings.h"
+#include "storage/mem_table.h"
 
 class LogStorage {
 public:
     LogStorage(std::shared_ptr<DAL> dal, std::shared_ptr<LogDAL> log_dal, const settings::UserSettings& settings);
 
-    std::optional<std::vector<byte>> Find(const std::vector<byte>& key);
-    bool Put(const std::vector<byte>& key, const std::vector<byte>& value);
-    bool Remove(const std::vector<byte>& key);
+    /// @brief Looks up the active memtable, then the immutable one
+    /// @param removed Set, if the newest record of key is a removal
+    /// @param sequence Records after it are ignored
+    std::optional<std::vector<byte>> Find(const std::vector<byte>& key, bool* removed = nullptr,
+                                          uint64_t sequence = std::numeric_limits<uint64_t>::max()) const;
+    /// @return Sequence of the durable log or nullopt, if memtable is over the hard limit or tree is full.
+    /// Record gets into memtable only after its log is synced. Safe to call concurrently
+    std::optional<uint64_t> Put(const std::vector<byte>& key, const std::vector<byte>& value);
+    std::optional<uint64_t> Remove(const std::vector<byte>& key);
 
-    void PushTransactionLogs(const std::vector<Log>& logs);
+    /// @brief Writes logs as one atomic record
+    /// @param durability Overrides durability of the settings
+    /// @return Sequence of the last log or 0, if there are no logs
+    uint64_t PushTransactionLogs(const std::vector<Log>& logs,
+                                 std::optional<settings::Durability> durability = std::nullopt);
 
-    std::list<Log>& GetLogs();
-    const std::list<Log>& GetLogs() const;
+    /// @return Whether Put and Remove take records now
+    bool CanWrite() const;
+    /// @return Sequence, that all records up to are in memtables. Snapshot at it never changes
+    uint64_t GetVisibleSequence() const;
+
+    const MemTable& GetMemTable() const;
+    /// @return Memtable, that is frozen for the flush, or nullptr
+    std::shared_ptr<const MemTable> GetImmutable() const;
     size_t Size();
+    /// @return Bytes, taken by the active memtable
+    size_t MemoryUsage() const;
 
-    void Clear();
+    /// @brief Makes the active memtable immutable and starts a fresh one
+    /// @warning Concurrent writers must be excluded and there must be no immutable memtable
+    void Freeze();
+    /// @brief Drops the immutable memtable, when it's merged into the tree
+    /// @return End of its logs. They are released by LogDAL::Release, which syncs, so it's called without locks
+    LogDAL::Checkpoint DropImmutable();
 
     static std::string ConvertToStr(const std::vector<byte> &data);
     static std::vector<byte> ConvertFromStr(const std::string& data);
 
 private:
-    void WriteLog(const Log& log);
-    void WriteLogToMemory(const Log& log);
+    uint64_t WriteLog(const Log::View& log);
+    void WriteLogToMemory(uint64_t sequence, const Log& log);
+    /// @brief Makes records from first to last visible to snapshots, once all the previous ones are
+    void Publish(uint64_t first, uint64_t last);
 
-    std::list<Log> memory_log_;
-    std::unordered_map<std::string, std::vector<std::list<Log>::iterator>> key_to_memory_log_;
+    std::shared_ptr<MemTable> mem_table_;
+    std::shared_ptr<MemTable> immutable_;
+    // End of the immutable memtable logs
+    LogDAL::Checkpoint immutable_end_{};
 
     settings::UserSettings settings_;
     std::shared_ptr<DAL> dal_;
     std::shared_ptr<LogDAL> log_dal_;
+
+    // Records are added to memtable out of order by concurrent writers, so they are published in order
+    mutable std::mutex visible_mutex_;
+    std::condition_variable visible_cv_;
+    uint64_t visible_sequence_ = 0;
 };
 
 #endif  // LOG_STORAGE_H_
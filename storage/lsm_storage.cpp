@@ -0,0 +1,270 @@
+#include "lsm_storage.h"
+
+#include <filesystem>
+#include <mutex>
+#include <unordered_set>
+
+#include "dal/file.h"
+#include "exception/exception.h"
+#include "memory/memory.h"
+
+namespace {
+
+constexpr size_t kUInt64Size = 8;
+constexpr size_t kChecksumSize = 4;
+
+}  // namespace
+
+LsmStorage::LsmStorage(const std::string& path, const settings::UserSettings& settings)
+    : path_(path)
+    , settings_(settings)
+    , compare_(comparator::GetFunction(settings.comparator, settings.custom_comparator)) {
+    ReadManifest();
+    RemoveOrphans();
+}
+
+std::optional<SSTable::Record> LsmStorage::Find(std::string_view key) const {
+    // Runs are searched from the newest one, level 0 runs come first
+    std::shared_lock lock(mutex_);
+    for (const auto& level : levels_) {
+        for (const auto& run : level) {
+            if (auto record = run.table->Find(key)) {
+                return record;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+void LsmStorage::Flush(const MemTable& table) {
+    if (table.Size() == 0) {
+        return;
+    }
+    uint64_t number = next_number_++;
+    SSTableBuilder builder(RunPath(number), table.Size(), settings_.bloom_bits_per_key);
+    // Removals are kept, as they hide older records in deeper levels
+    for (auto it = table.Begin(); it.Valid(); it.NextKey()) {
+        auto entry = it.Get();
+        builder.Add(entry.command, entry.key, entry.value);
+    }
+    builder.Finish();
+
+    Run run{number, std::make_shared<SSTable>(RunPath(number), compare_)};
+    auto levels = levels_;
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    levels[0].insert(levels[0].begin(), run);
+    // Run is visible only after the manifest is durable, so its logs can be released after Flush
+    WriteManifest(levels);
+
+    std::unique_lock lock(mutex_);
+    levels_ = std::move(levels);
+}
+
+bool LsmStorage::NeedsCompaction() const {
+    return CompactionLevel().has_value();
+}
+
+void LsmStorage::Compact() {
+    auto level = CompactionLevel();
+    if (!level.has_value()) {
+        return;
+    }
+    // Run set is changed only by this thread, so it's read without the lock
+    size_t output_level = *level + 1;
+    std::vector<Run> inputs = levels_[*level];
+    if (output_level < levels_.size()) {
+        inputs.insert(inputs.end(), levels_[output_level].begin(), levels_[output_level].end());
+    }
+    // Removals are needed only while there are older records below
+    bool last_level = true;
+    for (size_t i = output_level + 1; i < levels_.size(); ++i) {
+        last_level = last_level && levels_[i].empty();
+    }
+
+    size_t keys = 0;
+    std::vector<SSTable::Iterator> iterators;
+    for (const auto& input : inputs) {
+        keys += input.table->Size();
+        iterators.push_back(input.table->Begin());
+    }
+
+    uint64_t number = next_number_++;
+    bool empty = true;
+    {
+        SSTableBuilder builder(RunPath(number), keys, settings_.bloom_bits_per_key);
+        // Inputs are ordered from the newest one, so the first iterator with the smallest key wins
+        while (true) {
+            std::optional<size_t> smallest;
+            for (size_t i = 0; i < iterators.size(); ++i) {
+                if (!iterators[i].Valid()) {
+                    continue;
+                }
+                if (!smallest.has_value()) {
+                    smallest = i;
+                    continue;
+                }
+                auto key = iterators[i].Key();
+                auto smallest_key = iterators[*smallest].Key();
+                if (compare_(key.data(), key.size(), smallest_key.data(), smallest_key.size()) < 0) {
+                    smallest = i;
+                }
+            }
+            if (!smallest.has_value()) {
+                break;
+            }
+
+            auto& winner = iterators[*smallest];
+            if (!last_level || winner.Command() == Log::Command::PUT) {
+                builder.Add(winner.Command(), winner.Key(), winner.Value());
+                empty = false;
+            }
+            // Older records of the key are dropped
+            std::string key(winner.Key());
+            for (auto& it : iterators) {
+                if (it.Valid() && compare_(it.Key().data(), it.Key().size(), key.data(), key.size()) == 0) {
+                    it.Next();
+                }
+            }
+        }
+        if (!empty) {
+            builder.Finish();
+        }
+    }
+
+    auto levels = levels_;
+    levels[*level].clear();
+    if (output_level == levels.size()) {
+        levels.emplace_back();
+    }
+    levels[output_level].clear();
+    if (!empty) {
+        levels[output_level].push_back({number, std::make_shared<SSTable>(RunPath(number), compare_)});
+    }
+    WriteManifest(levels);
+
+    {
+        std::unique_lock lock(mutex_);
+        levels_ = std::move(levels);
+    }
+    // Files are removed, when the last reader drops them
+    for (const auto& input : inputs) {
+        input.table->MarkObsolete();
+    }
+}
+
+std::vector<size_t> LsmStorage::LevelSizes() const {
+    std::shared_lock lock(mutex_);
+    std::vector<size_t> sizes;
+    for (const auto& level : levels_) {
+        sizes.push_back(level.size());
+    }
+    return sizes;
+}
+
+std::string LsmStorage::RunPath(uint64_t number) const {
+    return path_ + "." + std::to_string(number) + ".sst";
+}
+
+std::optional<size_t> LsmStorage::CompactionLevel() const {
+    if (!levels_.empty() && levels_[0].size() >= settings_.lsm_level0_runs) {
+        return 0;
+    }
+    uint64_t limit = settings_.lsm_level_size;
+    for (size_t level = 1; level < levels_.size(); ++level) {
+        if (LevelBytes(level) > limit) {
+            return level;
+        }
+        limit *= settings_.lsm_level_ratio;
+    }
+    return std::nullopt;
+}
+
+uint64_t LsmStorage::LevelBytes(size_t level) const {
+    uint64_t bytes = 0;
+    for (const auto& run : levels_[level]) {
+        bytes += run.table->FileSize();
+    }
+    return bytes;
+}
+
+void LsmStorage::ReadManifest() {
+    auto manifest_path = path_ + ".lsm";
+    if (!std::filesystem::exists(manifest_path)) {
+        return;
+    }
+    auto data = file::ReadFile(manifest_path);
+
+    if (data.size() < 2 * kUInt64Size + kChecksumSize
+        || memory::crc32(data.data(), data.size() - kChecksumSize)
+            != memory::bytes_to_uint32(data.data() + data.size() - kChecksumSize)) {
+        throw dal_error::CorruptedBuffer("Manifest is corrupted.");
+    }
+    const byte* ptr = data.data();
+    const byte* end = data.data() + data.size() - kChecksumSize;
+    auto read = [&ptr, end]() {
+        if (ptr + kUInt64Size > end) {
+            throw dal_error::CorruptedBuffer("Manifest is corrupted.");
+        }
+        auto value = memory::bytes_to_uint64(ptr);
+        ptr += kUInt64Size;
+        return value;
+    };
+
+    next_number_ = read();
+    levels_.resize(read());
+    for (auto& level : levels_) {
+        auto runs = read();
+        for (uint64_t i = 0; i < runs; ++i) {
+            auto number = read();
+            level.push_back({number, std::make_shared<SSTable>(RunPath(number), compare_)});
+        }
+    }
+}
+
+void LsmStorage::WriteManifest(const Levels& levels) const {
+    std::vector<byte> data;
+    auto write = [&data](uint64_t value) {
+        data.resize(data.size() + kUInt64Size);
+        memory::uint64_to_bytes(data.data() + data.size() - kUInt64Size, value);
+    };
+    write(next_number_);
+    write(levels.size());
+    for (const auto& level : levels) {
+        write(level.size());
+        for (const auto& run : level) {
+            write(run.number);
+        }
+    }
+    data.resize(data.size() + kChecksumSize);
+    memory::uint32_to_bytes(data.data() + data.size() - kChecksumSize,
+                            memory::crc32(data.data(), data.size() - kChecksumSize));
+
+    file::WriteFileAtomic(path_ + ".lsm", data);
+}
+
+void LsmStorage::RemoveOrphans() const {
+    std::unordered_set<uint64_t> live;
+    for (const auto& level : levels_) {
+        for (const auto& run : level) {
+            live.insert(run.number);
+        }
+    }
+    auto table_path = std::filesystem::absolute(path_);
+    auto prefix = table_path.filename().string() + ".";
+    const std::string suffix = ".sst";
+    for (const auto& file : std::filesystem::directory_iterator(table_path.parent_path())) {
+        auto name = file.path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() || !name.starts_with(prefix) || !name.ends_with(suffix)) {
+            continue;
+        }
+        auto number = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (number.find_first_not_of("0123456789") != std::string::npos) {
+            continue;
+        }
+        if (!live.contains(std::stoull(number))) {
+            std::filesystem::remove(file.path());
+        }
+    }
+}
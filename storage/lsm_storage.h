@@ -0,0 +1,64 @@
+#ifndef LSM_STORAGE_H_
+#define LSM_STORAGE_H_
+
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dal/sstable.h"
+#include "memory/comparator.h"
+#include "settings/settings.h"
+#include "storage/mem_table.h"
+
+/// @brief Leveled log-structured storage of sorted runs.
+/// Level 0 keeps flushed memtables, newest first, their key ranges overlap. Every deeper level is a single run,
+/// each next one lsm_level_ratio times larger. Run set is recorded in manifest <path>.lsm,
+/// runs are <path>.<number>.sst. Lookups are thread-safe, Flush and Compact must be called by a single thread
+class LsmStorage {
+public:
+    LsmStorage(const std::string& path, const settings::UserSettings& settings);
+
+    /// @return The newest record of the key, removal included, or nullopt
+    std::optional<SSTable::Record> Find(std::string_view key) const;
+    /// @brief Writes the newest record of each memtable key into a new level 0 run
+    void Flush(const MemTable& table);
+
+    bool NeedsCompaction() const;
+    /// @brief Merges the first overflowed level into the next one
+    void Compact();
+
+    /// @return Number of runs in each level
+    std::vector<size_t> LevelSizes() const;
+
+private:
+    struct Run {
+        uint64_t number;
+        std::shared_ptr<SSTable> table;
+    };
+    using Levels = std::vector<std::vector<Run>>;
+
+    std::string RunPath(uint64_t number) const;
+    /// @brief Overflowed level or nullopt
+    std::optional<size_t> CompactionLevel() const;
+    uint64_t LevelBytes(size_t level) const;
+
+    void ReadManifest();
+    /// @brief Atomically replaces manifest with the given run set
+    void WriteManifest(const Levels& levels) const;
+    /// @brief Removes runs, that are not in manifest. They are left by crashes during flush or compaction
+    void RemoveOrphans() const;
+
+    std::string path_;
+    settings::UserSettings settings_;
+    comparator::CustomFunction compare_;
+
+    // Guards run set. Replaced runs are removed with the last reference to them
+    mutable std::shared_mutex mutex_;
+    Levels levels_;
+    uint64_t next_number_ = 1;
+};
+
+#endif  // LSM_STORAGE_H_
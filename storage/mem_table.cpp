@@ -0,0 +1,160 @@
+#include "mem_table.h"
+
+#include <cstring>
+#include <limits>
+#include <new>
+#include <random>
+
+struct MemTable::Node {
+    uint64_t sequence;
+    uint32_t key_size;
+    uint32_t value_size;
+    Log::Command command;
+    int height;
+    // Node is allocated with height links, key and value bytes follow them
+    std::atomic<Node*> next[1];
+
+    byte* Data() { return reinterpret_cast<byte*>(next + height); }
+    const byte* Data() const { return reinterpret_cast<const byte*>(next + height); }
+    std::string_view Key() const { return {Data(), key_size}; }
+    std::string_view Value() const { return {Data() + key_size, value_size}; }
+
+    static Node* New(Arena& arena, uint64_t sequence, Log::Command command, std::string_view key,
+                     std::string_view value, int height) {
+        size_t size = sizeof(Node) + (height - 1) * sizeof(std::atomic<Node*>) + key.size() + value.size();
+        auto node = new (arena.Allocate(size)) Node;
+        node->sequence = sequence;
+        node->key_size = key.size();
+        node->value_size = value.size();
+        node->command = command;
+        node->height = height;
+        for (int level = 0; level < height; ++level) {
+            new (&node->next[level]) std::atomic<Node*>(nullptr);
+        }
+        if (!key.empty()) {
+            std::memcpy(node->Data(), key.data(), key.size());
+        }
+        if (!value.empty()) {
+            std::memcpy(node->Data() + key.size(), value.data(), value.size());
+        }
+        return node;
+    }
+};
+
+MemTable::MemTable(comparator::CustomFunction compare)
+    : compare_(compare)
+    , head_(Node::New(arena_, 0, Log::Command::PUT, {}, {}, kMaxHeight)) {}
+
+void MemTable::Add(uint64_t sequence, Log::Command command, std::string_view key, std::string_view value) {
+    int height = RandomHeight();
+    auto node = Node::New(arena_, sequence, command, key, value, height);
+
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    while (height > max_height && !max_height_.compare_exchange_weak(max_height, height)) {}
+
+    Node* prev[kMaxHeight];
+    Node* next[kMaxHeight];
+    Node* start = head_;
+    for (int level = kMaxHeight - 1; level >= 0; --level) {
+        FindSplice(key, sequence, level, start, &prev[level], &next[level]);
+        start = prev[level];
+    }
+    // Node becomes visible, when it's linked on the lowest level. Upper levels only speed up search
+    for (int level = 0; level < height; ++level) {
+        while (true) {
+            node->next[level].store(next[level], std::memory_order_relaxed);
+            if (prev[level]->next[level].compare_exchange_strong(next[level], node, std::memory_order_release)) {
+                break;
+            }
+            // Concurrent insert got in between. Nodes are never removed, so search goes on from prev
+            FindSplice(key, sequence, level, prev[level], &prev[level], &next[level]);
+        }
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t last_sequence = last_sequence_.load(std::memory_order_relaxed);
+    while (sequence > last_sequence && !last_sequence_.compare_exchange_weak(last_sequence, sequence)) {}
+}
+
+std::optional<MemTable::Entry> MemTable::Find(std::string_view key, uint64_t sequence) const {
+    // Newest record of the key goes first, so the search stops at the first one, that is not newer
+    Node* node = head_;
+    Node* next = nullptr;
+    for (int level = max_height_.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+        FindSplice(key, sequence, level, node, &node, &next);
+    }
+    if (next == nullptr || compare_(next->Key().data(), next->key_size, key.data(), key.size()) != 0) {
+        return std::nullopt;
+    }
+    return Entry{next->sequence, next->command, next->Key(), next->Value()};
+}
+
+MemTable::Iterator MemTable::Begin() const {
+    return {this, head_->next[0].load(std::memory_order_acquire)};
+}
+
+size_t MemTable::Size() const {
+    return size_.load(std::memory_order_relaxed);
+}
+
+uint64_t MemTable::LastSequence() const {
+    return last_sequence_.load(std::memory_order_relaxed);
+}
+
+size_t MemTable::MemoryUsage() const {
+    return arena_.MemoryUsage();
+}
+
+int MemTable::Compare(const Node* node, std::string_view key, uint64_t sequence) const {
+    int result = compare_(node->Key().data(), node->key_size, key.data(), key.size());
+    if (result != 0) {
+        return result;
+    }
+    if (node->sequence == sequence) {
+        return 0;
+    }
+    return node->sequence > sequence ? -1 : 1;
+}
+
+void MemTable::FindSplice(std::string_view key, uint64_t sequence, int level, Node* start,
+                          Node** prev, Node** next) const {
+    Node* node = start;
+    while (true) {
+        Node* candidate = node->next[level].load(std::memory_order_acquire);
+        if (candidate == nullptr || Compare(candidate, key, sequence) >= 0) {
+            *prev = node;
+            *next = candidate;
+            return;
+        }
+        node = candidate;
+    }
+}
+
+int MemTable::RandomHeight() {
+    thread_local std::minstd_rand generator(std::random_device{}());
+    int height = 1;
+    while (height < kMaxHeight && generator() % 4 == 0) {
+        ++height;
+    }
+    return height;
+}
+
+MemTable::Iterator::Iterator(const MemTable* table, const Node* node) : table_(table), node_(node) {}
+
+bool MemTable::Iterator::Valid() const {
+    return node_ != nullptr;
+}
+
+MemTable::Entry MemTable::Iterator::Get() const {
+    return {node_->sequence, node_->command, node_->Key(), node_->Value()};
+}
+
+void MemTable::Iterator::Next() {
+    node_ = node_->next[0].load(std::memory_order_acquire);
+}
+
+void MemTable::Iterator::NextKey() {
+    auto key = node_->Key();
+    do {
+        Next();
+    } while (node_ != nullptr && table_->compare_(node_->Key().data(), node_->key_size, key.data(), key.size()) == 0);
+}
@@ -0,0 +1,81 @@
+#ifndef MEM_TABLE_H_
+#define MEM_TABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+#include "dal/log.h"
+#include "memory/type.h"
+#include "memory/arena.h"
+#include "memory/comparator.h"
+
+/// @brief Ordered in-memory table of log records.
+/// Records are sorted by key in table order, records of the same key from the newest one.
+/// Inserts are lock-free and may run concurrently, reads are wait-free. Records are never removed,
+/// their memory is taken from an arena and is freed with the table
+class MemTable {
+    struct Node;
+
+public:
+    struct Entry {
+        uint64_t sequence;
+        Log::Command command;
+        std::string_view key;
+        std::string_view value;
+    };
+
+    class Iterator {
+    public:
+        bool Valid() const;
+        Entry Get() const;
+        void Next();
+        /// @brief Skips older records of the current key
+        void NextKey();
+
+    private:
+        friend class MemTable;
+        Iterator(const MemTable* table, const Node* node);
+
+        const MemTable* table_;
+        const Node* node_;
+    };
+
+    explicit MemTable(comparator::CustomFunction compare);
+
+    MemTable(const MemTable&) = delete;
+    MemTable& operator=(const MemTable&) = delete;
+
+    /// @brief Inserts record. Sequence must be unique
+    void Add(uint64_t sequence, Log::Command command, std::string_view key, std::string_view value);
+    /// @return The newest record of the key, that is not newer than sequence
+    std::optional<Entry> Find(std::string_view key,
+                              uint64_t sequence = std::numeric_limits<uint64_t>::max()) const;
+
+    Iterator Begin() const;
+    size_t Size() const;
+    /// @return The highest sequence of records or 0
+    uint64_t LastSequence() const;
+    /// @return Bytes, allocated for records and index
+    size_t MemoryUsage() const;
+
+private:
+    static constexpr int kMaxHeight = 12;
+
+    int Compare(const Node* node, std::string_view key, uint64_t sequence) const;
+    /// @brief Finds neighbours of the position in level, starting from the given node
+    void FindSplice(std::string_view key, uint64_t sequence, int level, Node* start,
+                    Node** prev, Node** next) const;
+    static int RandomHeight();
+
+    comparator::CustomFunction compare_;
+    Arena arena_;
+    Node* head_;
+    std::atomic<int> max_height_ = 1;
+    std::atomic<size_t> size_ = 0;
+    std::atomic<uint64_t> last_sequence_ = 0;
+};
+
+#endif  // MEM_TABLE_H_
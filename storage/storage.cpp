@@ -1,92 +1,405 @@
 #include "storage.h"
 
+#include <algorithm>
+#include <filesystem>
 #include <memory>
-#include <ranges>
 #include <thread>
 #include <unordered_set>
 
+#include "dal/file.h"
+#include "memory/arena.h"
+
+namespace {
+
+constexpr size_t kMinFilterCapacity = 1024;
+// Changed ranges closer, than a journal frame header, are merged
+constexpr size_t kMinRangeGap = 32;
+
+std::shared_ptr<Node> ParseNode(uint64_t page_num, Page& page) {
+    std::shared_ptr<Node> node(new Node());
+    node->SetPageNum(page_num);
+    node->Deserialize(page.Data(), settings::kPageSize);
+    return node;
+}
+
+/// @return Offsets and sizes of changed byte ranges of page
+std::vector<std::pair<size_t, size_t>> DiffPages(const byte* before, const byte* after) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t offset = 0;
+    while (offset < settings::kPageSize) {
+        if (before[offset] == after[offset]) {
+            ++offset;
+            continue;
+        }
+        size_t end = offset + 1;
+        size_t same = 0;
+        for (size_t i = end; i < settings::kPageSize && same < kMinRangeGap; ++i) {
+            if (before[i] == after[i]) {
+                ++same;
+            } else {
+                same = 0;
+                end = i + 1;
+            }
+        }
+        ranges.emplace_back(offset, end - offset);
+        offset = end;
+    }
+    return ranges;
+}
+
+settings::UserSettings NormalizeSettings(settings::UserSettings settings) {
+    // Integer keys are always ordered numerically
+    if (settings.uint64_keys) {
+        settings.comparator = comparator::Type::kUInt64;
+    }
+    if (settings.comparator == comparator::Type::kCustom && settings.custom_comparator == nullptr) {
+        throw storage_error::SettingsMismatch("Custom comparator function is not set.");
+    }
+    if (settings.comparator == comparator::Type::kCustom && settings.custom_comparator_name.empty()) {
+        throw storage_error::SettingsMismatch("Custom comparator name is not set.");
+    }
+    // Limits under one arena block make memtable flush almost on every write
+    settings.memtable_soft_limit = std::max(settings.memtable_soft_limit, Arena::kDefaultBlockSize);
+    settings.memtable_hard_limit = std::max(settings.memtable_hard_limit, settings.memtable_soft_limit);
+    return settings;
+}
+
+}  // namespace
+
 Storage::Storage(
         const std::string& path,
         const settings::UserSettings& settings)
-    : settings_(settings),
+    : settings_(NormalizeSettings(settings)),
       dal_(new DAL(path, settings)),
       log_dal_(new LogDAL(path + ".log", settings)),
-      memory_log_dal_(new MemoryLogDAL(path + ".mlog", settings)),
+      // Shadow pages are never written in place, so there is nothing to undo
+      memory_log_dal_(settings.copy_on_write ? nullptr : new MemoryLogDAL(path + ".mlog", settings)),
       root_(dal_->GetMetaPtr()->GetRootPage()),
-      log_storage_(dal_, log_dal_, settings_){}
+      log_storage_(dal_, log_dal_, settings_) {
+    // Checkpoint, that was interrupted while its pages were written in place, is undone.
+    // Changes since the previous checkpoint are redone from the log
+    if (memory_log_dal_ != nullptr && memory_log_dal_->IsCommitted()) {
+        RollBackCheckpoint();
+    }
+    published_root_ = root_;
+    auto meta = dal_->GetMetaPtr();
+    auto comparator = static_cast<uint64_t>(settings_.comparator);
+    auto key_type = static_cast<uint64_t>(settings_.uint64_keys);
+    uint64_t comparator_id = 0;
+    if (settings_.comparator == comparator::Type::kCustom) {
+        comparator_id = memory::crc32(settings_.custom_comparator_name.data(), settings_.custom_comparator_name.size());
+    }
+    auto engine = static_cast<uint64_t>(settings_.engine);
+    if (root_ == 0 && !std::filesystem::exists(path + ".lsm")) {
+        // Empty table adopts requested order, key format and engine
+        meta->SetComparator(comparator);
+        meta->SetComparatorId(comparator_id);
+        meta->SetKeyType(key_type);
+        meta->SetEngine(engine);
+        // Runs of kLsm engine never touch the tree, so meta is not checkpointed by it
+        Checkpoint();
+    } else if (meta->GetEngine() != engine) {
+        throw storage_error::SettingsMismatch("Table was created with another storage engine.");
+    } else if (meta->GetComparator() != comparator || meta->GetComparatorId() != comparator_id) {
+        throw storage_error::SettingsMismatch("Table was created with another key comparator.");
+    } else if (meta->GetKeyType() != key_type) {
+        throw storage_error::SettingsMismatch("Table was created with another key type.");
+    }
+    if (settings_.engine == settings::Engine::kLsm) {
+        lsm_ = std::make_unique<LsmStorage>(path, settings_);
+    } else if (settings_.bloom_bits_per_key > 0) {
+        LoadFilter(path + ".bloom");
+    }
+    flush_thread_ = std::thread(&Storage::FlushLoop, this);
+}
+
+template <class Function>
+decltype(auto) Storage::VisitComparator(Function&& function) {
+    switch (settings_.comparator) {
+        case comparator::Type::kReverseBytewise:
+            return function(comparator::ReverseBytewise());
+        case comparator::Type::kUInt64:
+            return function(comparator::UInt64());
+        case comparator::Type::kCustom:
+            return function(comparator::Custom{settings_.custom_comparator});
+        default:
+            return function(comparator::Bytewise());
+    }
+}
 
 std::optional<std::vector<byte>> Storage::Find(const std::vector<byte>& key) {
+    CheckKey(key);
     std::shared_lock lock(mutex_);
-    auto log_result = log_storage_.Find(key);
-    if (log_result.has_value()) {
-        ClearState();
+    bool removed = false;
+    auto log_result = log_storage_.Find(key, &removed);
+    if (log_result.has_value() || removed) {
         return log_result;
     }
+    return FindMerged(key);
+}
 
-    auto result = FindInTree(key);
+std::shared_ptr<const Storage::Snapshot> Storage::GetSnapshot() {
+    // Sequence is read and registered at once, so a merge either sees the snapshot or doesn't need it
+    std::unique_lock lock(versions_mutex_);
+    auto sequence = log_storage_.GetVisibleSequence();
+    snapshots_.insert(sequence);
+    return {new Snapshot{sequence}, [this](const Snapshot* snapshot) {
+        ReleaseSnapshot(snapshot->sequence);
+        delete snapshot;
+    }};
+}
 
-    ClearState();
-    return result;
+std::optional<std::vector<byte>> Storage::Find(const std::vector<byte>& key, const Snapshot& snapshot) {
+    CheckKey(key);
+    {
+        std::shared_lock lock(mutex_);
+        bool removed = false;
+        auto log_result = log_storage_.Find(key, &removed, snapshot.sequence);
+        if (log_result.has_value() || removed) {
+            return log_result;
+        }
+    }
+    // Merged value is read before the versions, so a key, merged meanwhile, has its previous value saved
+    auto current = FindMerged(key);
+
+    std::shared_lock lock(versions_mutex_);
+    // Merged memtables, that are newer than the snapshot. The newest one with a visible record wins
+    for (auto it = merged_versions_.rbegin(); it != merged_versions_.rend(); ++it) {
+        if ((*it)->table->LastSequence() <= snapshot.sequence) {
+            break;
+        }
+        if (auto entry = (*it)->table->Find({key.data(), key.size()}, snapshot.sequence)) {
+            if (entry->command == Log::Command::PUT) {
+                return std::vector<byte>(entry->value.begin(), entry->value.end());
+            }
+            return std::nullopt;
+        }
+    }
+    // Otherwise the key has the value, it had before the first merge after the snapshot
+    for (const auto& versions : merged_versions_) {
+        if (versions->table->LastSequence() <= snapshot.sequence) {
+            continue;
+        }
+        auto before = versions->before.find(std::string(key.begin(), key.end()));
+        if (before != versions->before.end()) {
+            return before->second;
+        }
+    }
+    return current;
+}
+
+std::optional<std::vector<byte>> Storage::FindMerged(const std::vector<byte>& key) {
+    if (lsm_ != nullptr) {
+        auto record = lsm_->Find({key.data(), key.size()});
+        if (record.has_value() && record->command == Log::Command::PUT) {
+            return std::move(record->value);
+        }
+        return std::nullopt;
+    }
+
+    // Tree is changed by the flush thread, while memtables take writes. Lookup doesn't wait for it
+    if (!MayContain(key)) {
+        return std::nullopt;
+    }
+    return FindOptimistic(key);
 }
 
 void Storage::Put(const std::vector<byte>& key, const std::vector<byte>& value) {
-    std::unique_lock lock(mutex_);
-    // Log workflow
+    CheckKey(key);
+    // Log workflow. Memtable takes concurrent writers, so they only exclude memtable switch.
+    // Shared lock is held until the record is durable and applied, so it's never frozen half-written
+    std::shared_lock shared_lock(mutex_);
     if (log_storage_.Put(key, value)) {
+        bool flush = NeedsFreeze();
+        shared_lock.unlock();
+        CommitLog(flush);
         return;
     }
-    PushLogAsync();
-    // Tree workflow
+    shared_lock.unlock();
+
+    std::unique_lock lock(mutex_);
+    if (ReserveLog(lock)) {
+        log_storage_.Put(key, value);
+        bool flush = NeedsFreeze();
+        lock.unlock();
+        CommitLog(flush);
+        return;
+    }
+    // Tree workflow. Memtables are merged first, so their records don't hide the new value
+    FlushAll(lock);
+    std::unique_lock tree_lock(tree_mutex_);
     PutInTree(key, value);
     // Clear saved state
     ClearState();
+    // Record bypasses the log, so it's durable only in the file
+    Checkpoint();
 }
 
 void Storage::Remove(const std::vector<byte>& key) {
-    std::unique_lock lock(mutex_);
+    CheckKey(key);
     // Log workflow
+    std::shared_lock shared_lock(mutex_);
     if (log_storage_.Remove(key)) {
+        bool flush = NeedsFreeze();
+        shared_lock.unlock();
+        CommitLog(flush);
         return;
     }
-    // Tree workflow
+    shared_lock.unlock();
+
+    std::unique_lock lock(mutex_);
+    if (ReserveLog(lock)) {
+        log_storage_.Remove(key);
+        bool flush = NeedsFreeze();
+        lock.unlock();
+        CommitLog(flush);
+        return;
+    }
+    // Tree workflow. Memtables are merged first, so their records don't hide the new value
+    FlushAll(lock);
+    std::unique_lock tree_lock(tree_mutex_);
     RemoveInTree(key);
     // Clear saved state
     ClearState();
+    Checkpoint();
 }
 
 void Storage::Restore() {
-    auto saved_allocation = memory_log_dal_->GetSavedPageAllocations();
-    auto saved_pages = memory_log_dal_->GetSavedPages();
-
-    // This is redundant, but is here for extra safety
-    for (auto pg_num : saved_allocation)
-        dal_->ReleasePage(pg_num);
+    if (settings_.copy_on_write) {
+        // Nothing was written in place. Drop shadow copies and their pages
+        for (auto pg_num : new_pages_)
+            dal_->ReleasePage(pg_num);
+        DropCopyOnWrite();
+        return;
+    }
 
-    // First page must always be freelist
-    for (auto [pg_num, page] : saved_pages) {
-        page->SetPageNum(pg_num);
-        dal_->WritePage(page);
+    // Pages of the operation are buffered only when it's finished, so a failed one leaves nothing
+    dirty_nodes_.clear();
+    freed_pages_.clear();
+    // Pages, allocated by the operation, are free in the restored freelist
+    if (save_started_) {
+        dal_->ReloadFreeList();
     }
     save_started_ = false;
 }
 
 void Storage::ClearState() {
+    if (settings_.copy_on_write) {
+        return;
+    }
+    if (save_started_) {
+        CommitOperation();
+    }
+    save_started_ = false;
+}
+
+void Storage::CommitOperation() {
+    // Pages are buffered, they get into the file at the next checkpoint.
+    // Readers restart, if they read any of them meanwhile
+    auto slots = LockPages();
+    for (const auto& [page_num, node] : dirty_nodes_) {
+        auto page = dal_->AllocateEmptyPage();
+        page->SetPageNum(page_num);
+        node->Serialize(page->Data(), settings::kPageSize);
+        dal_->WritePage(page);
+    }
+    published_root_.store(root_, std::memory_order_release);
+    UnlockPages(slots);
+    dal_->DeferFreeList(false);
+    dal_->WritePage(dal_->GetFreeListPage());
+    dirty_nodes_.clear();
+    freed_pages_.clear();
+}
+
+void Storage::Checkpoint() {
+    dal_->WriteMeta();
+    // Shadow pages are written by the operations themselves. Log is released after it, so meta must be durable
+    if (settings_.copy_on_write) {
+        dal_->Sync();
+        return;
+    }
+    auto pages = dal_->GetDirtyPages();
+    if (pages.empty()) {
+        return;
+    }
+    WriteCheckpoint(pages, JournalCheckpoint(pages));
+}
+
+std::vector<Storage::PageRanges> Storage::JournalCheckpoint(const std::vector<std::shared_ptr<Page>>& pages) {
+    // Pages, that are free in the file, keep nothing to undo, so they are written whole
+    FreeList stored_free_list;
+    auto free_list_page = dal_->ReadStoredPage(dal_->GetMetaPtr()->GetFreeListPage());
+    stored_free_list.Deserialize(free_list_page->Data(), settings::kPageSize);
+
+    // Only changed bytes are journaled and written
+    std::vector<PageRanges> writes;
+    for (const auto& page : pages) {
+        if (stored_free_list.IsFree(page->GetPageNum())) {
+            writes.push_back({{0, settings::kPageSize}});
+            continue;
+        }
+        auto stored = dal_->ReadStoredPage(page->GetPageNum());
+        auto ranges = DiffPages(stored->Data(), page->Data());
+        size_t changed = 0;
+        for (auto [offset, size] : ranges) {
+            changed += size;
+        }
+        // Full image is cheaper, than many ranges
+        if (changed > settings::kPageSize / 2) {
+            memory_log_dal_->SavePage(stored);
+            writes.push_back({{0, settings::kPageSize}});
+            continue;
+        }
+        for (auto [offset, size] : ranges) {
+            memory_log_dal_->SavePageRange(page->GetPageNum(), offset, stored->Data() + offset, size);
+        }
+        writes.push_back(std::move(ranges));
+    }
+    // Journal batch is synced once, then the pages are written in place
+    memory_log_dal_->Commit();
+    return writes;
+}
+
+void Storage::WriteCheckpoint(const std::vector<std::shared_ptr<Page>>& pages,
+                              const std::vector<PageRanges>& writes) {
+    bool written = false;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        for (auto [offset, size] : writes[i]) {
+            dal_->WritePageRange(pages[i]->GetPageNum(), offset, pages[i]->Data() + offset, size);
+            written = true;
+        }
+    }
+    // Journal is needed, until the pages are durable. Idle checkpoint does no I/O
+    if (written) {
+        dal_->Sync();
+    }
     memory_log_dal_->Clear();
+    dal_->ClearDirtyPages(pages);
 }
 
-std::optional<std::vector<byte>> Storage::FindInTree(const std::vector<byte>& key) {
-    try {
-        return FindInTreeImpl(key);
+void Storage::RollBackCheckpoint() {
+    for (const auto& [pg_num, page] : memory_log_dal_->GetSavedPages()) {
+        dal_->WritePageRange(pg_num, 0, page->Data(), settings::kPageSize);
     }
-    catch (...)
-    {
-        Restore();
-        ClearState();
-        throw;
+    for (const auto& range : memory_log_dal_->GetSavedRanges()) {
+        dal_->WritePageRange(range.page_num, range.offset, range.data.data(), range.data.size());
     }
+    dal_->Sync();
+    memory_log_dal_->Clear();
+    // Meta and freelist are of the previous checkpoint again
+    dal_->Reload();
+    root_ = dal_->GetMetaPtr()->GetRootPage();
+    published_root_ = root_;
+}
+
+std::optional<std::vector<byte>> Storage::FindInTree(const std::vector<byte>& key) {
+    // Lookup changes nothing, so a failed one has no state to restore
+    return FindInTreeImpl(key);
 }
 
 void Storage::PutInTree(const std::vector<byte>& key, const std::vector<byte>& value) {
+    // Key of a failed put stays in the filter, which is only a false positive
+    AddToFilter(key);
     try {
         PutInTreeImpl(key, value);
     }
@@ -110,6 +423,96 @@ void Storage::RemoveInTree(const std::vector<byte>& key) {
     }
 }
 
+std::optional<std::vector<byte>> Storage::FindOptimistic(const std::vector<byte>& key) {
+    constexpr int kMaxRestarts = 16;
+    std::optional<std::vector<byte>> result;
+    for (int i = 0; i < kMaxRestarts; ++i) {
+        if (TryFindOptimistic(key, &result)) {
+            return result;
+        }
+    }
+    // Writers are excluded by the lock, so the next try sees a stable tree
+    std::shared_lock tree_lock(tree_mutex_);
+    while (!TryFindOptimistic(key, &result)) {
+    }
+    return result;
+}
+
+bool Storage::TryFindOptimistic(const std::vector<byte>& key, std::optional<std::vector<byte>>* result) {
+    auto page_num = published_root_.load(std::memory_order_acquire);
+    if (page_num == 0) {
+        *result = std::nullopt;
+        return true;
+    }
+    // Pages are parsed only after validation, as a page could be read, while a checkpoint writes it
+    auto version = ReadPageVersion(page_num);
+    auto page = dal_->ReadPage(page_num);
+    // Root could be replaced, while it was read
+    if (!ValidatePage(page_num, version) || published_root_.load(std::memory_order_acquire) != page_num) {
+        return false;
+    }
+    auto node = ParseNode(page_num, *page);
+    return VisitComparator([&](const auto& compare) {
+        while (true) {
+            auto [index, was_found] = FindKeyInNode(node, key, compare);
+            if (was_found) {
+                *result = node->Items()[index]->GetValue();
+                return true;
+            }
+            if (node->IsLeaf()) {
+                *result = std::nullopt;
+                return true;
+            }
+            auto child_page_num = (*node->ChildNodesPtr())[index];
+            auto child_version = ReadPageVersion(child_page_num);
+            page = dal_->ReadPage(child_page_num);
+            // Parent is checked again, so the child is still linked from it
+            if (!ValidatePage(child_page_num, child_version) || !ValidatePage(page_num, version)) {
+                return false;
+            }
+            page_num = child_page_num;
+            version = child_version;
+            node = ParseNode(page_num, *page);
+        }
+    });
+}
+
+uint64_t Storage::ReadPageVersion(uint64_t page_num) const {
+    const auto& slot = page_versions_[page_num % kPageVersionSlots];
+    auto version = slot.load(std::memory_order_acquire);
+    while (version % 2 == 1) {
+        std::this_thread::yield();
+        version = slot.load(std::memory_order_acquire);
+    }
+    return version;
+}
+
+bool Storage::ValidatePage(uint64_t page_num, uint64_t version) const {
+    return page_versions_[page_num % kPageVersionSlots].load(std::memory_order_acquire) == version;
+}
+
+std::vector<size_t> Storage::LockPages() {
+    std::set<size_t> slots;
+    for (const auto& [page_num, node] : dirty_nodes_) {
+        slots.insert(page_num % kPageVersionSlots);
+        slots.insert(node->GetPageNum() % kPageVersionSlots);
+    }
+    for (auto page_num : freed_pages_) {
+        slots.insert(page_num % kPageVersionSlots);
+    }
+    // Operations are committed by one writer at a time, so slots are incremented without a race
+    for (auto slot : slots) {
+        page_versions_[slot].fetch_add(1, std::memory_order_acq_rel);
+    }
+    return {slots.begin(), slots.end()};
+}
+
+void Storage::UnlockPages(const std::vector<size_t>& slots) {
+    for (auto slot : slots) {
+        page_versions_[slot].fetch_add(1, std::memory_order_release);
+    }
+}
+
 std::optional<std::vector<byte>> Storage::FindInTreeImpl(const std::vector<byte> &key) {
     if (root_ == 0) {
         return std::nullopt;
@@ -118,154 +521,260 @@ std::optional<std::vector<byte>> Storage::FindInTreeImpl(const std::vector<byte>
         if (node == std::nullptr_t()) {
             return std::nullopt;
         } else {
-            return std::make_optional(node->ItemsPtr()->operator[](index)->GetValue());
+            return std::make_optional(node->Items()[index]->GetValue());
         }
     }
 }
 
 void Storage::PutInTreeImpl(const std::vector<byte> &key, const std::vector<byte> &value) {
     std::shared_ptr<Item> new_item = std::make_shared<Item>(key, value);
-    std::shared_ptr<Node> root_node;
     if (root_ == 0) {
-        root_node = std::make_shared<Node>();
+        std::shared_ptr<Node> root_node = NewNode();
         root_node->AddItem(new_item, 0);
 
         WriteNode(root_node, true);
         // Update root_;
         root_ = root_node->GetPageNum();
         dal_->GetMetaPtr()->SetRootPage(root_);
+        if (settings_.copy_on_write) {
+            CommitCopyOnWrite({});
+        }
         return;
-    } else {
-        root_node = GetNode(root_);
     }
 
-    // Find node for insert and all ancestor page_nums
-    auto [insert_node, insert_index, ancestor_indices] = FindKey(key, false);
+    // Find node for insert and all ancestors
+    auto [insert_node, insert_index, path] = FindKey(key, false);
     // Add new item to the leaf node
-    if (!insert_node->ItemsPtr()->empty()) {
-        auto item = insert_node->ItemsPtr()->operator[](insert_index);
-        if (std::memcmp(item->KeyData(), key.data(), std::min(item->ByteLength(), key.size())) == 0) {
-            insert_node->ItemsPtr()->operator[](insert_index) = new_item;
-        } else {
-            insert_node->AddItem(new_item, insert_index);
-        }
+    const auto& items = insert_node->Items();
+    if (insert_index < items.size() && CompareKeys(items[insert_index]->GetKey(), key) == 0) {
+        (*insert_node->ItemsPtr())[insert_index] = new_item;
     } else {
         insert_node->AddItem(new_item, insert_index);
     }
-    WriteNode(insert_node, false);
+    // Overpopulated node doesn't fit the page. It's written by Split
+    if (!IsOverPopulated(insert_node)) {
+        WriteNode(insert_node, false);
+    }
 
-    // Get all ancestors
-    auto ancestors = GetNodes(ancestor_indices);
+    path.emplace_back(insert_node, insert_index);
 
     // Split nodes, except root, if necessary
-    for (int64_t i = ancestors.size() - 2; i >= 0; --i) {
-        auto parent_node = ancestors[i];
-        auto child_node = ancestors[i + 1];
-        auto child_index = ancestor_indices[i + 1];
+    for (int64_t i = path.size() - 2; i >= 0; --i) {
+        auto [parent_node, child_index] = path[i];
+        auto child_node = std::get<0>(path[i + 1]);
         if (IsOverPopulated(child_node)) {
             Split(parent_node, child_node, child_index);
         }
     }
 
     // Split root, if necessary
+    auto root_node = std::get<0>(path.front());
     if (IsOverPopulated(root_node)) {
-        std::shared_ptr<Node> new_root = std::make_shared<Node>();
-        new_root->SetPageNum(root_node->GetPageNum());
+        std::shared_ptr<Node> new_root = NewNode();
+        new_root->ChildNodesPtr()->emplace_back(root_node->GetPageNum());
+        WriteNode(new_root, true);
         Split(new_root, root_node, 0);
 
-        WriteNode(new_root, true);
         root_ = new_root->GetPageNum();
         dal_->GetMetaPtr()->SetRootPage(root_);
     }
+
+    if (settings_.copy_on_write) {
+        CommitCopyOnWrite(path);
+    }
 }
 
 void Storage::RemoveInTreeImpl(const std::vector<byte> &key) {
     if (root_ == 0) {
         return;
     }
-    auto root_node = GetNode(root_);
 
-    auto [remove_node, remove_index, ancestor_indices] = FindKey(key, true);
+    auto [remove_node, remove_index, path] = FindKey(key, true);
     if (remove_node == std::nullptr_t()) {
         return;
     }
 
+    path.emplace_back(remove_node, remove_index);
     if (remove_node->IsLeaf()) {
         RemoveFromLeaf(remove_node, remove_index);
     } else {
-        auto affected_nodes = RemoveFromInternal(remove_node, remove_index);
-        ancestor_indices.insert(ancestor_indices.end(), affected_nodes.begin(), affected_nodes.end());
+        RemoveFromInternal(remove_node, remove_index, &path);
     }
 
-    auto ancestors = GetNodes(ancestor_indices);
-    for (int64_t i = ancestors.size() - 2; i >= 0; --i) {
-        auto parent_node = ancestors[i];
-        auto node = ancestors[i + 1];
-        if (IsUnderPopulated(node)) {
-            RemoveAndRebalance(parent_node, node, ancestor_indices[i + 1]);
+    Rebalance(path, settings_.lazy_rebalance);
+    if (settings_.copy_on_write) {
+        CommitCopyOnWrite(path);
+    }
+}
+
+void Storage::Rebalance(const TreePath& path, bool lazy) {
+    for (int64_t i = path.size() - 2; i >= 0; --i) {
+        auto [parent_node, node_index] = path[i];
+        auto node = std::get<0>(path[i + 1]);
+        if (!IsUnderPopulated(node)) {
+            continue;
         }
+        // Underfull, but not empty nodes are tolerated and merged later by RebalanceDeferred
+        if (lazy && !node->Items().empty()) {
+            deferred_rebalance_.emplace(node->Items().front()->GetKey());
+            continue;
+        }
+        RemoveAndRebalance(parent_node, node, node_index);
     }
 
-    if (root_node->ItemsPtr()->empty() && !root_node->ChildNodesPtr()->empty()) {
-        root_ = ancestors[1]->GetPageNum();
+    auto root_node = std::get<0>(path.front());
+    if (root_node->Items().empty() && !root_node->ChildNodesPtr()->empty()) {
+        root_ = root_node->ChildNodesPtr()->front();
         dal_->GetMetaPtr()->SetRootPage(root_);
+        DeleteNode(root_node);
     }
-    else if (root_node->ItemsPtr()->empty()) {
+    else if (root_node->Items().empty()) {
         root_ = 0;
         dal_->GetMetaPtr()->SetRootPage(root_);
+        DeleteNode(root_node);
     }
 }
 
+void Storage::RebalanceDeferred() {
+    auto deferred_keys = std::move(deferred_rebalance_);
+    deferred_rebalance_.clear();
 
-std::shared_ptr<Node> Storage::GetNode(uint64_t page_num) {
-    std::shared_ptr<Page> page = dal_->ReadPage(page_num);
-    std::shared_ptr<Node> node(new Node());
+    for (const auto& key : deferred_keys) {
+        if (root_ == 0) {
+            break;
+        }
+        try {
+            // Key leads to the underfull node, or to the node, that replaced it
+            auto [node, index, path] = FindKey(key, false);
+            path.emplace_back(node, index);
+            Rebalance(path, false);
+            if (settings_.copy_on_write) {
+                CommitCopyOnWrite(path);
+            }
+        }
+        catch (...)
+        {
+            Restore();
+            ClearState();
+            throw;
+        }
+        ClearState();
+    }
+}
 
-    node->SetPageNum(page_num);
-    node->Deserialize(page->Data(), settings::kPageSize);
+
+std::shared_ptr<Node> Storage::NewNode() {
+    std::shared_ptr<Node> node = std::make_shared<Node>();
+    node->SetFixedKeys(settings_.uint64_keys);
     return node;
 }
 
-std::vector<std::shared_ptr<Node>> Storage::GetNodes(const std::vector<uint64_t>& page_nums) {
-    std::vector<std::shared_ptr<Node>> result;
-    for (auto page_num : page_nums) {
-        result.emplace_back(GetNode(page_num));
+std::shared_ptr<Node> Storage::GetNode(uint64_t page_num) {
+    // Modified nodes are not written until the operation is finished
+    if (auto it = dirty_nodes_.find(page_num); it != dirty_nodes_.end()) {
+        return it->second;
     }
-    return result;
+    return ParseNode(page_num, *dal_->ReadPage(page_num));
 }
 
 void Storage::WriteNode(const std::shared_ptr<Node>& node, bool is_new) {
-    std::shared_ptr<Page> page = dal_->AllocateEmptyPage();
-    UpdateSaveProcess();
+    if (settings_.copy_on_write) {
+        if (is_new) {
+            node->SetPageNum(dal_->GetNextPage());
+            new_pages_.emplace(node->GetPageNum());
+        }
+        dirty_nodes_[node->GetPageNum()] = node;
+        return;
+    }
 
+    UpdateSaveProcess();
     if (is_new) {
-        uint64_t new_page_num = dal_->GetNextPage();
-        node->SetPageNum(new_page_num);
-        page->SetPageNum(node->GetPageNum());
+        node->SetPageNum(dal_->GetNextPage());
+    }
+    // Node is buffered, when the operation is finished
+    dirty_nodes_[node->GetPageNum()] = node;
+}
 
-        memory_log_dal_->SavePageAllocation(node->GetPageNum());
+void Storage::DeleteNode(const std::shared_ptr<Node>& node) {
+    if (settings_.copy_on_write) {
+        dirty_nodes_.erase(node->GetPageNum());
+        if (new_pages_.erase(node->GetPageNum()) > 0) {
+            // Page was never published
+            dal_->ReleasePage(node->GetPageNum());
+        } else {
+            // Old tree version may be still read until the commit
+            freed_pages_.emplace(node->GetPageNum());
+        }
+        return;
+    }
+
+    UpdateSaveProcess();
+    dirty_nodes_.erase(node->GetPageNum());
+    freed_pages_.emplace(node->GetPageNum());
+    dal_->ReleasePage(node->GetPageNum());
+}
+
+void Storage::CommitCopyOnWrite(const TreePath& path) {
+    // Path copy. Ancestors of modified nodes are relinked, so they are shadowed too
+    for (const auto& [node, _] : path) {
+        auto page_num = node->GetPageNum();
+        if (!freed_pages_.contains(page_num) && !dirty_nodes_.contains(page_num)) {
+            dirty_nodes_[page_num] = node;
+        }
     }
-    else {
+
+    // Modified nodes are moved to fresh pages
+    std::unordered_map<uint64_t, uint64_t> shadow_pages;
+    for (const auto& [page_num, _] : dirty_nodes_) {
+        if (!new_pages_.contains(page_num)) {
+            shadow_pages[page_num] = dal_->GetNextPage();
+            freed_pages_.emplace(page_num);
+        }
+    }
+
+    for (const auto& [page_num, node] : dirty_nodes_) {
+        for (auto& child_page_num : *node->ChildNodesPtr()) {
+            if (auto it = shadow_pages.find(child_page_num); it != shadow_pages.end()) {
+                child_page_num = it->second;
+            }
+        }
+        if (auto it = shadow_pages.find(page_num); it != shadow_pages.end()) {
+            node->SetPageNum(it->second);
+        }
+    }
+
+    // Fresh pages could be read by readers of an older version, before they were freed
+    auto slots = LockPages();
+    for (const auto& [_, node] : dirty_nodes_) {
+        std::shared_ptr<Page> page = dal_->AllocateEmptyPage();
         page->SetPageNum(node->GetPageNum());
-        // Save node state before serialization
-        dal_->ReadPage(node->GetPageNum());
-        memory_log_dal_->SavePage(page);
+        node->Serialize(page->Data(), settings::kPageSize);
+        dal_->WritePage(page);
     }
+    // Root must never point to shadow pages, that are not on disk yet
+    dal_->Sync();
 
-    node->Serialize(page->Data(), settings::kPageSize);
-    dal_->WritePage(page);
+    // Publish new root. Single page write replaces the whole tree version
+    if (auto it = shadow_pages.find(root_); it != shadow_pages.end()) {
+        root_ = it->second;
+    }
+    dal_->GetMetaPtr()->SetRootPage(root_);
+    dal_->WriteMeta();
+    dal_->Sync();
+    published_root_.store(root_, std::memory_order_release);
+    UnlockPages(slots);
+
+    // Old version is unreachable now, also after a crash
+    for (auto page_num : freed_pages_) {
+        dal_->ReleasePage(page_num);
+    }
+    DropCopyOnWrite();
 }
 
-void Storage::DeleteNode(const std::shared_ptr<Node>& node) {
-    UpdateSaveProcess();
-    // Read node page
-    std::shared_ptr<Page> page = dal_->AllocateEmptyPage();
-    page->SetPageNum(node->GetPageNum());
-    // Save page, before deleting
-    dal_->ReadPage(node->GetPageNum());
-    memory_log_dal_->SavePage(page);
-
-    dal_->ReleasePage(node->GetPageNum());
+void Storage::DropCopyOnWrite() {
+    dirty_nodes_.clear();
+    new_pages_.clear();
+    freed_pages_.clear();
 }
 
 double Storage::MaxThreshhold() {
@@ -277,28 +786,32 @@ double Storage::MinThreshhold() {
 }
 
 bool Storage::IsOverPopulated(const std::shared_ptr<Node>& node) {
-    return node->ByteLength() > MaxThreshhold() && node->ItemsPtr()->size() > 1;
+    return node->ByteLength() > MaxThreshhold() && node->Items().size() > 1;
 }
 
 bool Storage::IsUnderPopulated(const std::shared_ptr<Node>& node) {
     return node->ByteLength() < MinThreshhold();
 }
 
-std::tuple<std::shared_ptr<Node>, size_t, std::vector<uint64_t>> Storage::FindKey(
+std::tuple<std::shared_ptr<Node>, size_t, Storage::TreePath> Storage::FindKey(
     const std::vector<byte>& key,
     bool exact_key) {
     std::shared_ptr<Node> root_node = GetNode(root_);
-    std::vector<uint64_t> ancestors;
-    auto [node, index] = FindKeyRecursive(root_node, key, exact_key, &ancestors);
-    return std::tie(node, index, ancestors);
+    TreePath path;
+    auto [node, index] = VisitComparator([&](const auto& compare) {
+        return FindKeyRecursive(root_node, key, exact_key, &path, compare);
+    });
+    return std::tie(node, index, path);
 }
 
+template <class Comparator>
 std::tuple<std::shared_ptr<Node>, size_t> Storage::FindKeyRecursive(
     const std::shared_ptr<Node>& node, 
     const std::vector<byte>& key,
     bool exact_key,
-    std::vector<uint64_t>* ancestors) {
-    auto [index, was_found] = FindKeyInNode(node, key);
+    TreePath* path,
+    const Comparator& compare) {
+    auto [index, was_found] = FindKeyInNode(node, key, compare);
     if (was_found) {
         return std::tie(node, index);
     }
@@ -310,19 +823,31 @@ std::tuple<std::shared_ptr<Node>, size_t> Storage::FindKeyRecursive(
         return std::forward_as_tuple(std::nullptr_t(), 0);
     }
 
-    ancestors->emplace_back(node->GetPageNum());
+    path->emplace_back(node, index);
 
     uint64_t child_page_num = (*node->ChildNodesPtr())[index];
     std::shared_ptr<Node> child_node = GetNode(child_page_num);
-    return FindKeyRecursive(child_node, key, exact_key, ancestors);
+    return FindKeyRecursive(child_node, key, exact_key, path, compare);
 }
 
+template <class Comparator>
 std::tuple<size_t, bool> Storage::FindKeyInNode(const std::shared_ptr<Node>& node,
-                                                const std::vector<byte>& key) {
-    for (size_t i = 0; i < node->ItemsPtr()->size(); ++i) {
-        std::shared_ptr<Item> item = (*node->ItemsPtr())[i];
-        int comp_result =
-            std::memcmp(item->KeyData(), key.data(), std::min(key.size(), item->KeySize()));
+                                                const std::vector<byte>& key,
+                                                const Comparator& compare) {
+    if constexpr (std::is_same_v<Comparator, comparator::UInt64>) {
+        const auto& packed_keys = node->PackedKeys();
+        if (!packed_keys.empty()) {
+            auto int_key = comparator::UInt64::ToUInt64(key.data(), key.size());
+            size_t index = InterpolationSearch(packed_keys, int_key);
+            bool was_found = index < packed_keys.size() && packed_keys[index] == int_key;
+            return std::forward_as_tuple(index, was_found);
+        }
+    }
+
+    const auto& items = node->Items();
+    for (size_t i = 0; i < items.size(); ++i) {
+        const auto& item = items[i];
+        int comp_result = compare(item->KeyData(), item->KeySize(), key.data(), key.size());
         if (comp_result == 0) {
             return std::forward_as_tuple(i, true);
         }
@@ -331,14 +856,58 @@ std::tuple<size_t, bool> Storage::FindKeyInNode(const std::shared_ptr<Node>& nod
             return std::forward_as_tuple(i, false);
         }
     }
-    return std::forward_as_tuple(node->ItemsPtr()->size(), false);
+    return std::forward_as_tuple(items.size(), false);
+}
+
+size_t Storage::InterpolationSearch(const std::vector<uint64_t>& keys, uint64_t key) {
+    if (keys.empty() || key <= keys.front()) {
+        return 0;
+    }
+    if (key > keys.back()) {
+        return keys.size();
+    }
+
+    // keys[left] < key <= keys[right]. Interpolation steps alternate with bisection,
+    // so skewed keys can't make the search linear
+    size_t left = 0;
+    size_t right = keys.size() - 1;
+    bool interpolate = true;
+    while (right - left > 1) {
+        size_t middle = left + (right - left) / 2;
+        if (interpolate) {
+            long double fraction = static_cast<long double>(key - keys[left]) / (keys[right] - keys[left]);
+            middle = left + static_cast<size_t>(fraction * (right - left));
+            middle = std::clamp(middle, left + 1, right - 1);
+        }
+        interpolate = !interpolate;
+
+        if (keys[middle] < key) {
+            left = middle;
+        } else {
+            right = middle;
+        }
+    }
+    return right;
+}
+
+void Storage::CheckKey(const std::vector<byte>& key) {
+    if (settings_.uint64_keys && key.size() != uint64_t_size) {
+        throw storage_error::InvalidKey("Key of integer keys table must be 8 bytes long.");
+    }
+}
+
+int Storage::CompareKeys(const std::vector<byte>& lhs, const std::vector<byte>& rhs) {
+    return VisitComparator([&](const auto& compare) {
+        return compare(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+    });
 }
 
 int64_t Storage::GetSplitIndex(const std::shared_ptr<Node>& node) {
-    size_t byte_length = node->HeaderByteLength();
-    size_t items_size = node->ItemsPtr()->size();
+    size_t items_size = node->Items().size();
+    // Only header of the left part is counted, otherwise large nodes are split right after the first item
+    size_t byte_length = node->HeaderByteLength() - items_size * node->ItemHeaderByteLength();
     for (size_t i = 0; i < items_size; ++i) {
-        byte_length += node->ItemsPtr()->operator[](i)->ByteLength();
+        byte_length += node->ItemHeaderByteLength() + node->ItemByteLength(i);
 
         if (1. * byte_length > MinThreshhold() && i < items_size - 1) {
             return i + 1;
@@ -357,8 +926,8 @@ void Storage::Split(const std::shared_ptr<Node>& parent, const std::shared_ptr<N
             "Insert failed. Split called on lonely/underpopulated node.");
     }
 
-    std::shared_ptr<Item> middle_item = child->ItemsPtr()->operator[](split_index);
-    std::shared_ptr<Node> new_node = std::make_shared<Node>();
+    std::shared_ptr<Item> middle_item = child->Items()[split_index];
+    std::shared_ptr<Node> new_node = NewNode();
 
     if (child->IsLeaf()) {
         (*new_node->ItemsPtr()) = {child->ItemsPtr()->begin() + split_index + 1,
@@ -384,7 +953,10 @@ void Storage::Split(const std::shared_ptr<Node>& parent, const std::shared_ptr<N
         parent->ChildNodesPtr()->insert(parent->ChildNodesPtr()->begin() + child_index + 1,
                                         new_node->GetPageNum());
     }
-    WriteNode(parent, false);
+    // Overpopulated parent is written by its own split
+    if (!IsOverPopulated(parent)) {
+        WriteNode(parent, false);
+    }
     WriteNode(child, false);
 }
 
@@ -393,50 +965,42 @@ void Storage::RemoveFromLeaf(const std::shared_ptr<Node>& node, size_t item_inde
     WriteNode(node, false);
 }
 
-std::vector<size_t> Storage::RemoveFromInternal(const std::shared_ptr<Node>& parent_node,
-                                                size_t item_index) {
-    /* Finds an element, that can replace current. Applies changes and returns touched nodes */
-    std::vector<size_t> affected_children = {item_index};
-
-    auto current_node_page = parent_node->ChildNodesPtr()->operator[](item_index);
-    auto current_node = GetNode(current_node_page);
+void Storage::RemoveFromInternal(const std::shared_ptr<Node>& parent_node, size_t item_index,
+                                 TreePath* path) {
+    /* Replaces an item with its predecessor from the left subtree. Touched nodes extend the path */
+    auto current_node = GetNode(parent_node->ChildNodesPtr()->operator[](item_index));
     while (!current_node->IsLeaf()) {
-        size_t next_index = current_node->ChildNodesPtr()->size() - 1;
-        current_node_page = parent_node->ChildNodesPtr()->operator[](next_index);
-        current_node = GetNode(current_node_page);
-
-        affected_children.emplace_back(next_index);
+        auto next_index = current_node->ChildNodesPtr()->size() - 1;
+        path->emplace_back(current_node, next_index);
+        current_node = GetNode(current_node->ChildNodesPtr()->operator[](next_index));
     }
 
     auto& parent_items = *parent_node->ItemsPtr();
     auto& current_items = *current_node->ItemsPtr();
-    parent_items[item_index] = current_items[current_items.size() - 1];
+    parent_items[item_index] = current_items.back();
+    current_items.pop_back();
+    path->emplace_back(current_node, current_items.size());
 
     WriteNode(parent_node, false);
     WriteNode(current_node, false);
-    return affected_children;
 }
 
 void Storage::LeftRotate(const std::shared_ptr<Node>& lhs, const std::shared_ptr<Node>& mhs,
-                         const std::shared_ptr<Node>& rhs, size_t r_node_index) {
+                         const std::shared_ptr<Node>& rhs, size_t l_node_index) {
     // Remove left element from rhs node
     std::shared_ptr<Item> r_item = rhs->ItemsPtr()->front();
     rhs->ItemsPtr()->erase(rhs->ItemsPtr()->begin());
 
-    // Update parents(middle) element
-    size_t parent_r_item = r_node_index;
-    if (r_node_index == mhs->ChildNodesPtr()->size() - 1) {
-        parent_r_item = r_node_index - 1;
-    }
-    std::shared_ptr<Item> m_item = mhs->ItemsPtr()->operator[](parent_r_item);
-    mhs->ItemsPtr()->operator[](parent_r_item) = r_item;
+    // Update parents(middle) element, which separates lhs and rhs
+    std::shared_ptr<Item> m_item = mhs->ItemsPtr()->operator[](l_node_index);
+    mhs->ItemsPtr()->operator[](l_node_index) = r_item;
 
     // Update left element
     lhs->ItemsPtr()->emplace_back(m_item);
 
     // Update leaves
     if (!rhs->IsLeaf()) {
-        auto child_node_ptr = rhs->ChildNodesPtr()->operator[](0);
+        auto child_node_ptr = rhs->ChildNodesPtr()->front();
         rhs->ChildNodesPtr()->erase(rhs->ChildNodesPtr()->begin());
 
         lhs->ChildNodesPtr()->emplace_back(child_node_ptr);
@@ -449,18 +1013,12 @@ void Storage::RightRotate(const std::shared_ptr<Node>& lhs, const std::shared_pt
     std::shared_ptr<Item> l_item = lhs->ItemsPtr()->back();
     lhs->ItemsPtr()->pop_back();
 
-    // Update parents(middle) element
-    size_t parent_r_item = 0;
-    if (r_node_index != 0) {
-        parent_r_item = r_node_index - 1;
-    } else {
-        parent_r_item = 0;
-    }
-    std::shared_ptr<Item> m_item = mhs->ItemsPtr()->operator[](parent_r_item);
-    mhs->ItemsPtr()->operator[](parent_r_item) = l_item;
+    // Update parents(middle) element, which separates lhs and rhs
+    std::shared_ptr<Item> m_item = mhs->ItemsPtr()->operator[](r_node_index - 1);
+    mhs->ItemsPtr()->operator[](r_node_index - 1) = l_item;
 
     // Update right element
-    rhs->ItemsPtr()->insert(rhs->ItemsPtr()->begin(), l_item);
+    rhs->ItemsPtr()->insert(rhs->ItemsPtr()->begin(), m_item);
 
     // Update leaves
     if (!lhs->IsLeaf()) {
@@ -471,40 +1029,34 @@ void Storage::RightRotate(const std::shared_ptr<Node>& lhs, const std::shared_pt
     }
 }
 
-void Storage::Merge(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& unbalanced,
-                    size_t u_node_index) {
-    uint64_t lhs_node_ptr = parent->ChildNodesPtr()->operator[](u_node_index - 1);
-    auto lhs_node = GetNode(lhs_node_ptr);
-
-    // Update parent. Move item from parent to left_node
-    auto parent_item = parent->ItemsPtr()->operator[](u_node_index - 1);
-    parent->ItemsPtr()->erase(parent->ItemsPtr()->begin() + u_node_index - 1);
-    lhs_node->ItemsPtr()->emplace_back(parent_item);
-
-    // Add unbalanced items to left node
-    for (auto item : *unbalanced->ItemsPtr()) {
-        lhs_node->ItemsPtr()->emplace_back(item);
-        if (!lhs_node->IsLeaf()) {
-            lhs_node->ItemsPtr()->emplace_back(item);    
-        }
+void Storage::Merge(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& lhs,
+                    const std::shared_ptr<Node>& rhs, size_t r_node_index) {
+    // Update parent. Move item from parent to left node and unlink right node
+    auto parent_item = parent->ItemsPtr()->operator[](r_node_index - 1);
+    parent->ItemsPtr()->erase(parent->ItemsPtr()->begin() + r_node_index - 1);
+    parent->ChildNodesPtr()->erase(parent->ChildNodesPtr()->begin() + r_node_index);
+    lhs->ItemsPtr()->emplace_back(parent_item);
+
+    // Add right node items to left node
+    for (const auto& item : rhs->Items()) {
+        lhs->ItemsPtr()->emplace_back(item);
     }
-    if (!lhs_node->IsLeaf()) {
-        for (auto child_ptr: *unbalanced->ChildNodesPtr()) {
-            lhs_node->ChildNodesPtr()->emplace_back(child_ptr);
-        }
+    for (auto child_ptr: *rhs->ChildNodesPtr()) {
+        lhs->ChildNodesPtr()->emplace_back(child_ptr);
     }
 
     WriteNode(parent, false);
-    WriteNode(lhs_node, false);
-    DeleteNode(unbalanced);
+    WriteNode(lhs, false);
+    DeleteNode(rhs);
 }
 
 void Storage::RemoveAndRebalance(const std::shared_ptr<Node>& parent,
                               const std::shared_ptr<Node>& unbalanced, size_t u_node_index) {
     // Right rotate, if we can
+    std::shared_ptr<Node> lhs_node;
     if (u_node_index != 0) {
-        auto lhs_node = GetNode(parent->ChildNodesPtr()->operator[](u_node_index - 1));
-        if (!IsUnderPopulated(lhs_node)) {
+        lhs_node = GetNode(parent->ChildNodesPtr()->operator[](u_node_index - 1));
+        if (!IsUnderPopulated(lhs_node) && lhs_node->Items().size() > 1) {
             RightRotate(lhs_node, parent, unbalanced, u_node_index);
             WriteNode(lhs_node, false);
             WriteNode(parent, false);
@@ -515,9 +1067,10 @@ void Storage::RemoveAndRebalance(const std::shared_ptr<Node>& parent,
     }
 
     // Left rotate, if we can
+    std::shared_ptr<Node> rhs_node;
     if (u_node_index != parent->ChildNodesPtr()->size() - 1) {
-        auto rhs_node = GetNode(parent->ChildNodesPtr()->operator[](u_node_index + 1));
-        if (!IsUnderPopulated(rhs_node)) {
+        rhs_node = GetNode(parent->ChildNodesPtr()->operator[](u_node_index + 1));
+        if (!IsUnderPopulated(rhs_node) && rhs_node->Items().size() > 1) {
             LeftRotate(unbalanced, parent, rhs_node, u_node_index);
             WriteNode(rhs_node, false);
             WriteNode(parent, false);
@@ -527,64 +1080,310 @@ void Storage::RemoveAndRebalance(const std::shared_ptr<Node>& parent,
         }
     }
 
-    // Nothing worked. Merge
+    // Nothing worked. Merge with already read sibling
     if (u_node_index == 0) {
-        auto rhs_node = GetNode(parent->ChildNodesPtr()->operator[](u_node_index + 1));
-        Merge(parent, rhs_node, u_node_index);
+        Merge(parent, unbalanced, rhs_node, u_node_index + 1);
 
         return;
     }
-    Merge(parent, unbalanced, u_node_index);
+    Merge(parent, lhs_node, unbalanced, u_node_index);
+}
+
+void Storage::CommitLog(bool flush) {
+    if (flush) {
+        std::unique_lock lock(mutex_);
+        // Another writer could freeze memtable first
+        if (NeedsFreeze()) {
+            Freeze();
+        }
+    }
+}
+
+bool Storage::NeedsFreeze() {
+    // While the frozen memtable is merged, the active one takes writes up to the hard limit.
+    // Empty memtable is never frozen, so the flush thread can't spin on it
+    return log_storage_.GetImmutable() == nullptr && log_storage_.Size() > 0
+        && log_storage_.MemoryUsage() >= settings_.memtable_soft_limit;
+}
+
+void Storage::Freeze() {
+    log_storage_.Freeze();
+    flush_cv_.notify_all();
+}
+
+bool Storage::ReserveLog(std::unique_lock<std::shared_mutex>& lock) {
+    // Writer stalls over the hard limit, until there is a memtable with free space.
+    // Lock is released meanwhile, as the flush thread takes it
+    if (log_storage_.MemoryUsage() >= settings_.memtable_hard_limit) {
+        WaitFlush(lock);
+        if (log_storage_.MemoryUsage() >= settings_.memtable_hard_limit) {
+            Freeze();
+        }
+    }
+    return log_storage_.CanWrite();
+}
+
+void Storage::WaitFlush(std::unique_lock<std::shared_mutex>& lock, bool released) {
+    flush_cv_.wait(lock, [this, released]() {
+        return (log_storage_.GetImmutable() == nullptr && !(released && log_release_pending_)) || flush_failure_;
+    });
+    if (flush_failure_) {
+        std::rethrow_exception(flush_failure_);
+    }
+}
+
+void Storage::FlushAll(std::unique_lock<std::shared_mutex>& lock) {
+    WaitFlush(lock);
+    if (log_storage_.Size() > 0) {
+        Freeze();
+    }
+    WaitFlush(lock, true);
 }
 
 void Storage::PushLog() {
     std::unique_lock lock(mutex_);
+    FlushAll(lock);
+}
 
-    const auto& logs = log_storage_.GetLogs();
-    std::unordered_set<std::string> used_keys;
-    for (auto log : std::ranges::reverse_view(logs)) {
-        if (used_keys.contains(LogStorage::ConvertToStr(log.GetValue()))) {
-            continue;
+void Storage::FlushLoop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        flush_cv_.wait(lock, [this]() { return flush_stop_ || log_storage_.GetImmutable() != nullptr; });
+        // Immutable memtable is only dropped by this thread, so it's read without the lock
+        auto immutable = log_storage_.GetImmutable();
+        if (immutable == nullptr) {
+            return;
+        }
+        lock.unlock();
+        try {
+            MergeMemTable(immutable);
+            lock.lock();
+            auto checkpoint = log_storage_.DropImmutable();
+            log_release_pending_ = true;
+            // Active memtable could be filled during the merge
+            if (NeedsFreeze()) {
+                log_storage_.Freeze();
+            }
+            flush_cv_.notify_all();
+            lock.unlock();
+            // Log meta and recycled segments are synced, while writers go on.
+            // Only this thread releases logs, so checkpoints are released in order
+            log_dal_->Release(checkpoint);
+        } catch (...) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            log_release_pending_ = false;
+            flush_failure_ = std::current_exception();
+            flush_cv_.notify_all();
+            return;
+        }
+        lock.lock();
+        log_release_pending_ = false;
+        flush_cv_.notify_all();
+    }
+}
+
+void Storage::MergeMemTable(const std::shared_ptr<const MemTable>& table) {
+    auto versions = RetainVersions(table);
+    if (lsm_ != nullptr) {
+        if (versions != nullptr) {
+            for (auto it = table->Begin(); it.Valid(); it.NextKey()) {
+                auto key = it.Get().key;
+                auto record = lsm_->Find(key);
+                SaveVersion(versions.get(), key, record.has_value() && record->command == Log::Command::PUT
+                                                     ? std::make_optional(std::move(record->value))
+                                                     : std::nullopt);
+            }
+        }
+        // Memtable becomes a run, which doesn't block readers. Compaction follows on this thread
+        lsm_->Flush(*table);
+        while (lsm_->NeedsCompaction()) {
+            lsm_->Compact();
         }
-        used_keys.emplace(LogStorage::ConvertToStr(log.GetKey()));
+        return;
+    }
 
-        if (log.GetCommand() == Log::Command::PUT) {
-            PutInTree(log.GetKey(), log.GetValue());
+    // Memtable is ordered, only the newest record of each key is applied
+    for (auto it = table->Begin(); it.Valid(); it.NextKey()) {
+        auto entry = it.Get();
+        std::vector<byte> key(entry.key.begin(), entry.key.end());
+        // Tree is locked per record, so readers are not stalled for the whole merge
+        std::unique_lock tree_lock(tree_mutex_);
+        if (versions != nullptr) {
+            SaveVersion(versions.get(), entry.key, MayContain(key) ? FindInTree(key) : std::nullopt);
+        }
+        if (entry.command == Log::Command::PUT) {
+            PutInTree(key, {entry.value.begin(), entry.value.end()});
         } else {
-            RemoveInTree(log.GetKey());
+            RemoveInTree(key);
+        }
+        // Each record is a separate tree update, so its pages are buffered before the tree lock is released
+        ClearState();
+        // Buffer is bounded, so a long merge is checkpointed on the way
+        if (dal_->GetDirtyPageCount() >= settings_.buffer_pool_pages) {
+            Checkpoint();
+        }
+    }
+
+    {
+        // Deferred merges run only here, so writers never pay for them
+        std::unique_lock tree_lock(tree_mutex_);
+        if (deferred_rebalance_.size() >= settings_.max_deferred_rebalance) {
+            RebalanceDeferred();
         }
     }
-    log_storage_.Clear();
+    // Readers go on during the checkpoint. Memtable logs are released after it,
+    // as they redo all the changes, that are not in the file yet
+    std::shared_lock tree_lock(tree_mutex_);
+    Checkpoint();
 }
 
-void Storage::PushLogAsync() {
-    if (log_thread_.joinable()) {
-        log_thread_.join();
+std::shared_ptr<Storage::MergedVersions> Storage::RetainVersions(const std::shared_ptr<const MemTable>& table) {
+    // Snapshots, taken after the freeze, see the whole memtable
+    std::unique_lock lock(versions_mutex_);
+    if (snapshots_.empty() || *snapshots_.begin() >= table->LastSequence()) {
+        return nullptr;
     }
-    log_thread_ = std::thread([this]() mutable {
-        PushLog();
-    });
-    // Thread is not joined here. Call is a non_blocking operation, whether previous logic is finished
-    // Thread is joined before another start or in destructor
+    merged_versions_.push_back(std::make_shared<MergedVersions>(MergedVersions{table, {}}));
+    return merged_versions_.back();
+}
+
+void Storage::SaveVersion(MergedVersions* versions, std::string_view key, std::optional<std::vector<byte>> value) {
+    std::unique_lock lock(versions_mutex_);
+    versions->before.emplace(std::string(key), std::move(value));
+}
+
+void Storage::ReleaseSnapshot(uint64_t sequence) {
+    std::unique_lock lock(versions_mutex_);
+    snapshots_.erase(snapshots_.find(sequence));
+    while (!merged_versions_.empty()
+           && (snapshots_.empty() || merged_versions_.front()->table->LastSequence() <= *snapshots_.begin())) {
+        merged_versions_.pop_front();
+    }
+}
+
+bool Storage::MayContain(const std::vector<byte>& key) const {
+    auto filter = filter_.load(std::memory_order_acquire);
+    return filter == nullptr || filter->MayContain({key.data(), key.size()});
+}
+
+void Storage::AddToFilter(const std::vector<byte>& key) {
+    if (filter_ == nullptr) {
+        return;
+    }
+    // Overwrites are counted too, so the filter is rebuilt a bit earlier than needed
+    if (filter_keys_ == filter_capacity_) {
+        RebuildFilter();
+    }
+    ++filter_keys_;
+    filter_.load()->Add({key.data(), key.size()});
+}
+
+void Storage::RebuildFilter() {
+    std::vector<std::vector<byte>> keys;
+    std::vector<uint64_t> pages;
+    if (root_ != 0) {
+        pages.push_back(root_);
+    }
+    while (!pages.empty()) {
+        auto node = GetNode(pages.back());
+        pages.pop_back();
+        for (const auto& item : node->Items()) {
+            keys.push_back(item->GetKey());
+        }
+        const auto& children = *node->ChildNodesPtr();
+        pages.insert(pages.end(), children.begin(), children.end());
+    }
+
+    filter_capacity_ = std::max<uint64_t>(2 * keys.size(), kMinFilterCapacity);
+    filter_keys_ = keys.size();
+    auto filter = std::make_unique<BloomFilter>(filter_capacity_, settings_.bloom_bits_per_key);
+    for (const auto& key : keys) {
+        filter->Add({key.data(), key.size()});
+    }
+    PublishFilter(std::move(filter));
+}
+
+void Storage::PublishFilter(std::unique_ptr<BloomFilter> filter) {
+    filters_.push_back(std::move(filter));
+    filter_.store(filters_.back().get(), std::memory_order_release);
+}
+
+void Storage::LoadFilter(const std::string& path) {
+    // [root][capacity][keys][filter][crc32]
+    constexpr size_t kHeaderSize = 3 * sizeof(uint64_t);
+    filter_path_ = path;
+    if (std::filesystem::exists(path)) {
+        auto data = file::ReadFile(path);
+        // Filter of another tree state is not used, it could miss keys
+        if (data.size() > kHeaderSize + sizeof(uint32_t)
+            && memory::crc32(data.data(), data.size() - sizeof(uint32_t))
+                == memory::bytes_to_uint32(data.data() + data.size() - sizeof(uint32_t))
+            && memory::bytes_to_uint64(data.data()) == root_) {
+            filter_capacity_ = memory::bytes_to_uint64(data.data() + sizeof(uint64_t));
+            filter_keys_ = memory::bytes_to_uint64(data.data() + 2 * sizeof(uint64_t));
+            PublishFilter(std::make_unique<BloomFilter>(
+                std::vector<byte>(data.begin() + kHeaderSize, data.end() - sizeof(uint32_t))));
+        }
+        // Tree is changed from now on, so the file is stale until the next clean close
+        file::RemoveFile(path);
+    }
+    if (filter_ == nullptr) {
+        RebuildFilter();
+    }
+}
+
+void Storage::SaveFilter() {
+    if (filter_ == nullptr) {
+        return;
+    }
+    const auto& filter = filter_.load()->Data();
+    std::vector<byte> data(3 * sizeof(uint64_t) + filter.size() + sizeof(uint32_t));
+    memory::uint64_to_bytes(data.data(), root_);
+    memory::uint64_to_bytes(data.data() + sizeof(uint64_t), filter_capacity_);
+    memory::uint64_to_bytes(data.data() + 2 * sizeof(uint64_t), filter_keys_);
+    std::copy(filter.begin(), filter.end(), data.begin() + 3 * sizeof(uint64_t));
+    memory::uint32_to_bytes(data.data() + data.size() - sizeof(uint32_t),
+                            memory::crc32(data.data(), data.size() - sizeof(uint32_t)));
+    file::WriteFileAtomic(filter_path_, data);
 }
 
 void Storage::UpdateSaveProcess() {
     if (!save_started_) {
-        auto freelist_page = dal_->GetFreeListPage();
-        memory_log_dal_->SavePage(freelist_page);
+        // Freelist is buffered with the operation pages
+        dal_->DeferFreeList(true);
 
         save_started_ = true;
     }
 }
 
 Storage::~Storage() {
-    if (log_thread_.joinable()) {
-        log_thread_.join();
+    {
+        std::unique_lock lock(mutex_);
+        if (!flush_failure_) {
+            FlushAll(lock);
+        }
+        flush_stop_ = true;
+        flush_cv_.notify_all();
     }
-    PushLog();
+    flush_thread_.join();
+    RebalanceDeferred();
+    if (!flush_failure_) {
+        Checkpoint();
+    }
+    SaveFilter();
 }
 
-void Storage::PushTransactionLogs(const std::vector<Log> &logs) {
-    // Transactions logs should always be stored no matter logs are full or not
-    log_storage_.PushTransactionLogs(logs);
+void Storage::PushTransactionLogs(const std::vector<Log> &logs, std::optional<settings::Durability> durability) {
+    for (const auto& log : logs) {
+        CheckKey(log.GetKey());
+    }
+    // Transactions logs should always be stored no matter logs are full or not.
+    // Like a single record, they only exclude memtable switch, so concurrent commits share log syncs
+    std::shared_lock shared_lock(mutex_);
+    log_storage_.PushTransactionLogs(logs, durability);
+    bool flush = NeedsFreeze();
+    shared_lock.unlock();
+    CommitLog(flush);
 }
@@ -1,11 +1,19 @@
 #ifndef STORAGE_H_
 #define STORAGE_H_
 
+#include <array>
+#include <atomic>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <tuple>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <shared_mutex>
 #include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <thread>
 
 #include "dal/dal.h"
@@ -13,20 +21,35 @@
 #include "dal/memory_log_dal.h"
 #include "dal/node.h"
 #include "memory/type.h"
+#include "memory/bloom_filter.h"
+#include "memory/comparator.h"
 #include "settings/settings.h"
 #include "storage/log_storage.h"
+#include "storage/lsm_storage.h"
 
 class Storage {
+    // Visited nodes from root and index of child (or item, for the last one), the path goes through
+    using TreePath = std::vector<std::tuple<std::shared_ptr<Node>, size_t>>;
+
    public:
     Storage(const std::string& path,
             const settings::UserSettings& settings);
     ~Storage();
 
+    /// @brief State of the table at a log sequence. Snapshot reads don't see the later records
+    struct Snapshot {
+        uint64_t sequence;
+    };
+
     std::optional<std::vector<byte>> Find(const std::vector<byte>& key);
+    /// @brief Pins the latest visible state. Versions, it needs, are kept until it's released
+    std::shared_ptr<const Snapshot> GetSnapshot();
+    std::optional<std::vector<byte>> Find(const std::vector<byte>& key, const Snapshot& snapshot);
     void Put(const std::vector<byte>& key, const std::vector<byte>& value);
     void Remove(const std::vector<byte>& key);
 
-    void PushTransactionLogs(const std::vector<Log>& logs);
+    void PushTransactionLogs(const std::vector<Log>& logs,
+                             std::optional<settings::Durability> durability = std::nullopt);
 
     /// @brief Restores saved state
     void Restore();
@@ -44,12 +67,45 @@ class Storage {
     void PutInTreeImpl(const std::vector<byte>& key, const std::vector<byte>& value);
     void RemoveInTreeImpl(const std::vector<byte>& key);
 
+    // Optimistic reads. Each page has a version, which is odd, while a commit publishes the page.
+    // Readers take no locks, they validate versions of the pages on their path and restart on a change
+    /// @brief Looks up key in the tree. Falls back to the shared tree lock, if it's restarted too often
+    std::optional<std::vector<byte>> FindOptimistic(const std::vector<byte>& key);
+    /// @return Whether the lookup saw a consistent tree, otherwise result is not set
+    bool TryFindOptimistic(const std::vector<byte>& key, std::optional<std::vector<byte>>* result);
+    /// @brief Waits, while page is published, and returns its version
+    uint64_t ReadPageVersion(uint64_t page_num) const;
+    bool ValidatePage(uint64_t page_num, uint64_t version) const;
+    /// @brief Makes versions of the modified and freed pages odd, until they are unlocked
+    /// @return Locked version slots
+    std::vector<size_t> LockPages();
+    void UnlockPages(const std::vector<size_t>& slots);
+
     // Memory workflow functions
+    std::shared_ptr<Node> NewNode();
     std::shared_ptr<Node> GetNode(uint64_t page_num);
-    std::vector<std::shared_ptr<Node>> GetNodes(const std::vector<uint64_t>& page_nums);
     void WriteNode(const std::shared_ptr<Node>& node, bool is_new);
     /// @warning Forbidden to change state of node, before delete
     void DeleteNode(const std::shared_ptr<Node>& node);
+    /// @brief Buffers modified nodes and the freelist of the finished operation
+    void CommitOperation();
+
+    // Checkpoints. Buffered pages are written in place under the undo journal, so the file is either
+    // at the previous checkpoint or at this one. Log keeps everything since the previous checkpoint
+    using PageRanges = std::vector<std::pair<size_t, size_t>>;
+    /// @brief Writes meta and buffered pages and makes them durable
+    void Checkpoint();
+    /// @brief Journals changed byte ranges of pages against the file and commits the journal
+    /// @return Ranges of each page to write
+    std::vector<PageRanges> JournalCheckpoint(const std::vector<std::shared_ptr<Page>>& pages);
+    /// @brief Writes journaled pages in place and clears the journal, once they are durable
+    void WriteCheckpoint(const std::vector<std::shared_ptr<Page>>& pages, const std::vector<PageRanges>& writes);
+    /// @brief Undoes committed journal of an interrupted checkpoint
+    void RollBackCheckpoint();
+    /// @brief Writes modified nodes and their path to fresh pages and publishes the new root
+    /// @param path Page nums from root, visited by the operation
+    void CommitCopyOnWrite(const TreePath& path);
+    void DropCopyOnWrite();
     // Threshold calls
     double MaxThreshhold();
     double MinThreshhold();
@@ -58,38 +114,104 @@ class Storage {
     // B-Tree algorithms
 
     // Find helpers
-    std::tuple<std::shared_ptr<Node>, size_t, std::vector<uint64_t>> FindKey(
+    std::tuple<std::shared_ptr<Node>, size_t, TreePath> FindKey(
         const std::vector<byte>& key, bool exact_key);
+    template <class Comparator>
     std::tuple<std::shared_ptr<Node>, size_t> FindKeyRecursive(const std::shared_ptr<Node>& node,
                                                                const std::vector<byte>& key,
                                                                bool exact_key,
-                                                               std::vector<uint64_t>* ancestors);
+                                                               TreePath* path,
+                                                               const Comparator& compare);
+    template <class Comparator>
     std::tuple<size_t, bool> FindKeyInNode(const std::shared_ptr<Node>& node,
-                                           const std::vector<byte>& key);
+                                           const std::vector<byte>& key,
+                                           const Comparator& compare);
+    /// @brief Lower bound in sorted unique keys of fixed keys node
+    static size_t InterpolationSearch(const std::vector<uint64_t>& keys, uint64_t key);
+    void CheckKey(const std::vector<byte>& key);
+    int CompareKeys(const std::vector<byte>& lhs, const std::vector<byte>& rhs);
+    /// @brief Calls function with comparator policy of the table, so comparisons are inlined
+    template <class Function>
+    decltype(auto) VisitComparator(Function&& function);
     // Put helpers
     int64_t GetSplitIndex(const std::shared_ptr<Node>& node);
     void Split(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& child,
                size_t childIndex);
     // Remove helpers
     void RemoveFromLeaf(const std::shared_ptr<Node>& node, size_t item_index);
-    std::vector<uint64_t> RemoveFromInternal(const std::shared_ptr<Node>& parent_node,
-                                             size_t item_index);
+    void RemoveFromInternal(const std::shared_ptr<Node>& parent_node, size_t item_index,
+                            TreePath* path);
     void LeftRotate(const std::shared_ptr<Node>& lhs, const std::shared_ptr<Node>& mhs,
-                    const std::shared_ptr<Node>& rhs, size_t r_node_index);
+                    const std::shared_ptr<Node>& rhs, size_t l_node_index);
     void RightRotate(const std::shared_ptr<Node>& lhs, const std::shared_ptr<Node>& mhs,
                      const std::shared_ptr<Node>& rhs, size_t r_node_index);
-    void Merge(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& unbalanced,
-               size_t u_node_index);
+    void Merge(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& lhs,
+               const std::shared_ptr<Node>& rhs, size_t r_node_index);
     void RemoveAndRebalance(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& unbalanced,
                          size_t u_node_index);
+    /// @brief Fixes underpopulated nodes on the path bottom-up and shrinks the root if needed
+    /// @param lazy Underpopulated, but not empty nodes are deferred to RebalanceDeferred
+    void Rebalance(const TreePath& path, bool lazy);
+    /// @brief Merges nodes, that were left underpopulated by lazy removes
+    void RebalanceDeferred();
+
+    // Tree filter. Keys are added on put and never removed, so it answers most lookups of absent keys
+    // without page reads. Filter file is valid only after clean close, so it's removed on open
+    // and rebuilt from the tree after a crash. Changed under tree_mutex_, checked without locks
+    bool MayContain(const std::vector<byte>& key) const;
+    void AddToFilter(const std::vector<byte>& key);
+    /// @brief Fills a fresh filter with tree keys, sized for twice their number
+    void RebuildFilter();
+    void PublishFilter(std::unique_ptr<BloomFilter> filter);
+    void LoadFilter(const std::string& path);
+    void SaveFilter();
 
+    // Memtable flush. Full memtable is frozen and merged into the tree by the flush thread,
+    // while a fresh one takes writes. Functions with lock argument must be called under exclusive lock,
+    // which is released while waiting
+    /// @brief Finishes log workflow of a durable record
+    /// @param flush Whether memtable is over the soft limit and is to be frozen
+    void CommitLog(bool flush);
+    bool NeedsFreeze();
+    void Freeze();
+    /// @brief Waits for a memtable with free space over the hard limit
+    /// @return Whether log can take a record now
+    bool ReserveLog(std::unique_lock<std::shared_mutex>& lock);
+    /// @brief Waits until the frozen memtable is merged
+    /// @param released Whether to wait for its logs to be released too
+    void WaitFlush(std::unique_lock<std::shared_mutex>& lock, bool released = false);
+    /// @brief Merges both memtables into the tree and releases their logs
+    void FlushAll(std::unique_lock<std::shared_mutex>& lock);
     void PushLog();
-    void PushLogAsync();
+    void FlushLoop();
+    void MergeMemTable(const std::shared_ptr<const MemTable>& table);
+    /// @brief Lookup in the tree or sorted runs, memtables are not checked
+    std::optional<std::vector<byte>> FindMerged(const std::vector<byte>& key);
+
+    // Snapshot versions. Memtable, merged while an older snapshot is taken, is kept with the values,
+    // its keys had before the merge. Entries go in merge order and are dropped with the last snapshot before them
+    struct MergedVersions {
+        std::shared_ptr<const MemTable> table;
+        // Key -> value before the merge or nullopt, if there was none. Filled during the merge
+        std::unordered_map<std::string, std::optional<std::vector<byte>>> before;
+    };
+    /// @return Versions to fill during the merge or nullptr, if no snapshot is older than the table
+    std::shared_ptr<MergedVersions> RetainVersions(const std::shared_ptr<const MemTable>& table);
+    void SaveVersion(MergedVersions* versions, std::string_view key, std::optional<std::vector<byte>> value);
+    void ReleaseSnapshot(uint64_t sequence);
 
     void UpdateSaveProcess();
 
+    // Guards memtables switch and the tree workflow. Writers to the memtable take it shared
     std::shared_mutex mutex_;
-    std::thread log_thread_;
+    // Guards tree pages, which are changed by the flush thread
+    std::shared_mutex tree_mutex_;
+    // Flush state, guarded by mutex_
+    std::condition_variable_any flush_cv_;
+    bool flush_stop_ = false;
+    // Set, while logs of the merged memtable are released without the lock
+    bool log_release_pending_ = false;
+    std::exception_ptr flush_failure_;
 
     settings::UserSettings settings_;
 
@@ -99,9 +221,41 @@ class Storage {
     std::shared_ptr<MemoryLogDAL> memory_log_dal_;
 
     uint64_t root_;
+    // Root of the last finished operation, the one readers start from
+    std::atomic<uint64_t> published_root_ = 0;
+    static constexpr size_t kPageVersionSlots = 4096;
+    // Versions of pages, that share a slot, change together
+    std::array<std::atomic<uint64_t>, kPageVersionSlots> page_versions_{};
+    // Modified nodes of running tree operation. They are written to fresh pages in copy-on-write mode
+    // and buffered until the next checkpoint, otherwise
+    std::unordered_map<uint64_t, std::shared_ptr<Node>> dirty_nodes_;
+    std::unordered_set<uint64_t> new_pages_;
+    // Pages, freed by the running operation. Their versions are changed on commit, as readers may be on them
+    std::unordered_set<uint64_t> freed_pages_;
+
+    // First keys of underpopulated nodes, which rebalance was deferred
+    std::set<std::vector<byte>> deferred_rebalance_;
+
+    std::string filter_path_;
+    // Replaced filters are kept until close, as readers may still check them. Each one is
+    // twice smaller, than the next, so together they take less memory, than the current one
+    std::vector<std::unique_ptr<BloomFilter>> filters_;
+    std::atomic<BloomFilter*> filter_ = nullptr;
+    // Keys, the filter is sized for, and keys added to it
+    uint64_t filter_capacity_ = 0;
+    uint64_t filter_keys_ = 0;
 
     // Storage extension
     LogStorage log_storage_;
+    // Sorted runs, which take memtables instead of the tree in kLsm engine
+    std::unique_ptr<LsmStorage> lsm_;
+
+    // Guards snapshots and merged versions
+    std::shared_mutex versions_mutex_;
+    std::multiset<uint64_t> snapshots_;
+    std::deque<std::shared_ptr<MergedVersions>> merged_versions_;
+
+    std::thread flush_thread_;
 };
 
 #endif  // STORAGE_H_
\ No newline at end of file
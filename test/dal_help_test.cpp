@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <filesystem>
+
 #define private public
 #define protected public
 
@@ -9,12 +12,16 @@
 #include "dal/num_list.h"
 #include "dal/meta.h"
 #include "dal/log.h"
+#include "dal/sstable.h"
+#include "memory/arena.h"
+#include "memory/bloom_filter.h"
 
 
 TEST(Meta, All) {
     Meta meta;
     meta.SetRootPage(1);
     meta.SetFreeListPage(0);
+    meta.SetComparator(2);
     auto meta_magic = meta.GetMagicWord();
     auto meta_size = meta.GetSize();
 
@@ -27,40 +34,118 @@ TEST(Meta, All) {
     ASSERT_EQ(saved_meta.GetMagicWord(), meta_magic);
     ASSERT_EQ(saved_meta.GetRootPage(), 1);
     ASSERT_EQ(saved_meta.GetFreeListPage(), 0);
+    ASSERT_EQ(saved_meta.GetComparator(), 2);
 }
 
-TEST(MemoryLogMeta, All) {
-    MemoryLogMeta meta;
-    meta.SetAllocatedPage(1);
-    meta.SetDirtyPage(2);
-    meta.SetDataStartPage(3);
+TEST(LogMeta, All) {
+    LogMeta meta;
     auto meta_magic = meta.GetMagicWord();
     auto meta_size = meta.GetSize();
 
     std::vector<byte> data(meta_size);
     meta.Serialize(data.data(), meta_size);
 
-    MemoryLogMeta saved_meta;
+    LogMeta saved_meta;
+    saved_meta.SetStartSequence(5);
     saved_meta.Deserialize(data.data(), meta_size);
     ASSERT_EQ(saved_meta.GetSize(), meta_size);
     ASSERT_EQ(saved_meta.GetMagicWord(), meta_magic);
-    ASSERT_EQ(saved_meta.GetDirtyPage(), 2);
-    ASSERT_EQ(saved_meta.GetAllocatedPage(), 1);
-    ASSERT_EQ(saved_meta.GetDataStartPage(), 3);
+    ASSERT_EQ(saved_meta.GetStartSequence(), meta.GetStartSequence());
 }
 
-TEST(LogMeta, All) {
-    LogMeta meta;
-    auto meta_magic = meta.GetMagicWord();
-    auto meta_size = meta.GetSize();
+TEST(Memory, Crc32) {
+    const char data[] = "123456789";
+    ASSERT_EQ(memory::crc32(data, 9), 0xCBF43926);
+    ASSERT_EQ(memory::crc32(data, 0), 0);
+}
 
-    std::vector<byte> data(meta_size);
-    meta.Serialize(data.data(), meta_size);
+TEST(Memory, Arena) {
+    Arena arena(1024);
+    ASSERT_EQ(arena.MemoryUsage(), 0);
+    ASSERT_EQ(arena.BlockOverhead(), 1024);
+
+    std::vector<byte*> pointers;
+    for (size_t i = 1; i < 100; ++i) {
+        auto pointer = arena.Allocate(i);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(pointer) % alignof(std::max_align_t), 0);
+        std::memset(pointer, static_cast<int>(i), i);
+        pointers.push_back(pointer);
+    }
+    for (size_t i = 1; i < 100; ++i) {
+        ASSERT_EQ(pointers[i - 1][i - 1], static_cast<byte>(i));
+    }
+    // Usage is counted by allocated bytes, unused tails of blocks are overhead
+    size_t allocated = 0;
+    for (size_t i = 1; i < 100; ++i) {
+        allocated += (i + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    }
+    ASSERT_EQ(arena.MemoryUsage(), allocated);
+    ASSERT_EQ((arena.MemoryUsage() + arena.BlockOverhead()) % 1024, 0);
+
+    auto usage = arena.MemoryUsage();
+    auto overhead = arena.BlockOverhead();
+    arena.Allocate(1000);
+    ASSERT_EQ(arena.MemoryUsage(), usage + 1008);
+    ASSERT_EQ(arena.BlockOverhead(), overhead);
+}
 
-    LogMeta saved_meta;
-    saved_meta.Deserialize(data.data(), meta_size);
-    ASSERT_EQ(saved_meta.GetSize(), meta_size);
-    ASSERT_EQ(saved_meta.GetMagicWord(), meta_magic);
+TEST(Memory, BloomFilter) {
+    BloomFilter filter(1000, 10);
+    for (int i = 0; i < 1000; ++i) {
+        filter.Add("key" + std::to_string(i));
+    }
+    BloomFilter restored(filter.Data());
+    int false_positives = 0;
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(restored.MayContain("key" + std::to_string(i)));
+        false_positives += restored.MayContain("other" + std::to_string(i));
+    }
+    ASSERT_LT(false_positives, 50);
+}
+
+TEST(SSTable, All) {
+    auto compare = comparator::GetFunction(comparator::Type::kBytewise, nullptr);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; ++i) {
+        keys.push_back("key" + std::to_string(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    {
+        SSTableBuilder builder("sstable_test.sst", keys.size(), 10);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            builder.Add(i % 5 == 0 ? Log::Command::REMOVE : Log::Command::PUT, keys[i], "value" + keys[i]);
+        }
+        builder.Finish();
+    }
+    {
+        SSTable table("sstable_test.sst", compare);
+        ASSERT_EQ(table.Size(), keys.size());
+        // Data spans many blocks, each lookup reads one of them
+        ASSERT_GT(table.index_.size(), 10);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto record = table.Find(keys[i]);
+            ASSERT_TRUE(record.has_value());
+            ASSERT_EQ(record->command, i % 5 == 0 ? Log::Command::REMOVE : Log::Command::PUT);
+            ASSERT_EQ(std::string(record->value.begin(), record->value.end()), "value" + keys[i]);
+        }
+        ASSERT_FALSE(table.Find("key").has_value());
+        ASSERT_FALSE(table.Find("zzz").has_value());
+
+        size_t count = 0;
+        for (auto it = table.Begin(); it.Valid(); it.Next()) {
+            ASSERT_EQ(it.Key(), keys[count]);
+            ++count;
+        }
+        ASSERT_EQ(count, keys.size());
+        table.MarkObsolete();
+    }
+    ASSERT_FALSE(std::filesystem::exists("sstable_test.sst"));
+    {
+        // Unfinished run is removed
+        SSTableBuilder builder("sstable_test.sst", 1, 10);
+        builder.Add(Log::Command::PUT, "key", "value");
+    }
+    ASSERT_FALSE(std::filesystem::exists("sstable_test.sst"));
 }
 
 TEST(FreeList, All) {
@@ -119,6 +204,38 @@ TEST(Node, All) {
     ASSERT_EQ(node.items_[0]->value_, saved_node.items_[0]->value_);
 }
 
+TEST(Node, FixedKeys) {
+    Node node;
+    node.SetFixedKeys(true);
+    for (uint64_t i = 0; i < 3; ++i) {
+        std::vector<byte> key(8);
+        memory::uint64_to_bytes(key.data(), i * 1000);
+        node.AddItem(std::make_shared<Item>(key, std::vector<byte>(i + 1, 'a')), i);
+    }
+    // Key length is not stored per item
+    ASSERT_EQ(node.ByteLength(), 3 + 3 * 8 + 3 * 8 + 6);
+
+    std::vector<byte> memory(node.ByteLength());
+    node.Serialize(memory.data(), node.ByteLength());
+
+    Node saved_node;
+    saved_node.Deserialize(memory.data(), node.ByteLength());
+
+    ASSERT_TRUE(saved_node.HasFixedKeys());
+    ASSERT_EQ(saved_node.PackedKeys(), std::vector<uint64_t>({0, 1000, 2000}));
+    ASSERT_EQ(saved_node.items_.size(), 3);
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_EQ(node.items_[i]->key_, saved_node.items_[i]->key_);
+        ASSERT_EQ(node.items_[i]->value_, saved_node.items_[i]->value_);
+    }
+
+    // Reads keep packed keys, only mutable access drops them
+    ASSERT_EQ(saved_node.Items().size(), 3);
+    ASSERT_EQ(saved_node.PackedKeys().size(), 3);
+    saved_node.ItemsPtr();
+    ASSERT_TRUE(saved_node.PackedKeys().empty());
+}
+
 TEST(NumList, All) {
     NumList num_list;
     num_list.GetDataPtr()->push_back(10);
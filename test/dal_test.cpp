@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <thread>
 
 #define private public
 #define protected public
@@ -79,6 +80,24 @@ TEST_F(EmptyDalTest, Workflow) {
     }
 }
 
+TEST_F(EmptyDalTest, CanWrite) {
+    // Writers check free pages, while page I/O holds the file mutex
+    {
+        std::unique_lock lock(dal_->mutex_);
+        bool can_write = false;
+        std::thread([this, &can_write]() { can_write = dal_->CanWrite(); }).join();
+        ASSERT_TRUE(can_write);
+    }
+    while (dal_->free_list_->HasFreePages()) {
+        dal_->GetNextPage();
+    }
+    ASSERT_FALSE(dal_->CanWrite());
+    dal_->ReleasePage(1);
+    ASSERT_TRUE(dal_->CanWrite());
+    dal_->Close();
+    ASSERT_FALSE(dal_->CanWrite());
+}
+
 class LogDalTest : public ::testing::Test {
 protected:
     std::shared_ptr<LogDAL> dal_;
@@ -87,6 +106,8 @@ protected:
         if (std::filesystem::exists("test.db.log")) {
             std::filesystem::remove("test.db.log");
             std::filesystem::copy_file("../test/data/test.db.log", "test.db.log");
+            std::filesystem::remove("test.db.log.0");
+            std::filesystem::copy_file("../test/data/test.db.log.0", "test.db.log.0");
         }
         settings::UserSettings settings;
         dal_ = std::make_shared<LogDAL>("test.db.log", settings);
@@ -186,21 +207,40 @@ TEST(MemoryLogDAL, OpenClose) {
 }
 
 TEST_F(EmptyMemoryLogDalTest, Workflow) {
+    settings::UserSettings settings;
     {
-        auto page = dal_->AllocateEmptyPage();
+        auto page = std::make_shared<Page>(settings::kPageSize);
         page->SetPageNum(10);
         page->Data()[0] = '#';
 
         ASSERT_NO_THROW(dal_->SavePage(page));
         ASSERT_NO_THROW(dal_->SavePageAllocation(11));
+        ASSERT_NO_THROW(dal_->SavePageRange(12, 100, "old", 3));
     }
     {
         auto pages = dal_->GetSavedPages();
+        ASSERT_EQ(pages.size(), 1);
         ASSERT_EQ(pages[0].first, 10);
         ASSERT_EQ(pages[0].second->Data()[0], '#');
         auto allocations = dal_->GetSavedPageAllocations();
         ASSERT_EQ(allocations[0], 11);
     }
+    // Batch is in the file only after the commit
+    ASSERT_FALSE(MemoryLogDAL("test.db.mlog", settings).IsCommitted());
+    dal_->Commit();
+    {
+        MemoryLogDAL dal("test.db.mlog", settings);
+        ASSERT_TRUE(dal.IsCommitted());
+        ASSERT_EQ(dal.GetSavedPages()[0].second->Data()[0], '#');
+        ASSERT_EQ(dal.GetSavedPageAllocations(), std::vector<uint64_t>{11});
+        auto ranges = dal.GetSavedRanges();
+        ASSERT_EQ(ranges.size(), 1);
+        ASSERT_EQ(ranges[0].page_num, 12);
+        ASSERT_EQ(ranges[0].offset, 100);
+        ASSERT_EQ(std::string(ranges[0].data.begin(), ranges[0].data.end()), "old");
+    }
+    dal_->Clear();
+    ASSERT_FALSE(MemoryLogDAL("test.db.mlog", settings).IsCommitted());
 }
 
 TEST_F(MemoryLogDalTest, Workflow) {
@@ -212,3 +252,207 @@ TEST_F(MemoryLogDalTest, Workflow) {
     ASSERT_EQ(allocations.size(), 1);
     ASSERT_EQ(allocations[0], 11);
 }
+
+TEST_F(EmptyLogDalTest, GroupCommit) {
+    std::vector<byte> data(6);
+    std::memcpy(data.data(), "World", 6);
+
+    // Queued logs are written by the first waiter
+    auto first = dal_->Append(Log(Log::Command::PUT, {'a'}, data));
+    auto second = dal_->Append(Log(Log::Command::PUT, {'b'}, data));
+    ASSERT_TRUE(dal_->ReadLogBuffer().empty());
+    dal_->WaitDurable(first);
+    ASSERT_NO_THROW(dal_->WaitDurable(second));
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 2 * Log(Log::Command::PUT, {'a'}, data).GetByteLength());
+
+    std::vector<std::thread> threads;
+    for (byte thread_index = 0; thread_index < 8; ++thread_index) {
+        threads.emplace_back([this, thread_index, &data]() {
+            for (byte i = 0; i < 50; ++i) {
+                dal_->WriteLog(Log(Log::Command::PUT, {thread_index, i}, data));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto buffer = dal_->ReadLogBuffer();
+    size_t count = 0;
+    for (size_t offset = 0; offset < buffer.size(); ++count) {
+        offset += Log::readFromBuffer(buffer.data() + offset, buffer.size() - offset).GetByteLength();
+    }
+    ASSERT_EQ(count, 2 + 8 * 50);
+
+    // Clearing drops queued logs and releases their waiters
+    auto cleared = dal_->Append(Log(Log::Command::REMOVE, {'a'}));
+    dal_->ClearLogs();
+    ASSERT_NO_THROW(dal_->WaitDurable(cleared));
+    ASSERT_TRUE(dal_->ReadLogBuffer().empty());
+}
+
+TEST_F(EmptyLogDalTest, QueueReuse) {
+    std::string key = "key";
+    std::string value(100, '#');
+    Log::View log{Log::Command::PUT, key, value};
+    dal_->WaitDurable(dal_->Append(log));
+    dal_->WaitDurable(dal_->Append(log));
+    // Queue buffers are swapped between batches and never reallocated
+    const byte* buffers[] = {dal_->pending_.data(), dal_->batch_.data()};
+    for (int i = 0; i < 100; ++i) {
+        dal_->WaitDurable(dal_->Append(log));
+        ASSERT_TRUE(dal_->pending_.data() == buffers[0] || dal_->pending_.data() == buffers[1]);
+        ASSERT_TRUE(dal_->batch_.data() == buffers[0] || dal_->batch_.data() == buffers[1]);
+    }
+
+    // View is serialized the same way as log
+    auto buffer = dal_->ReadLogBuffer();
+    auto view = Log::ReadView(buffer.data(), buffer.size());
+    ASSERT_EQ(view.key, key);
+    ASSERT_EQ(view.value, value);
+    ASSERT_EQ(buffer.size(), 102 * Log(Log::Command::PUT, {'k', 'e', 'y'}, std::vector<byte>(100, '#')).GetByteLength());
+}
+
+TEST_F(EmptyLogDalTest, FailedBatch) {
+    Log log(Log::Command::PUT, {'a'}, std::vector<byte>(6, '#'));
+    dal_->WriteLog(log);
+
+    // Writes to the segment fail from now on
+    ::close(dal_->segment_fds_[0]);
+    auto lost = dal_->Append(log);
+    ASSERT_THROW(dal_->WaitDurable(lost), dal_error::FileError);
+    // No record follows the lost one, so reopened log keeps all acknowledged ones
+    ASSERT_THROW(dal_->Append(log), dal_error::FileError);
+    dal_->segment_fds_.erase(0);
+    dal_->Close();
+
+    settings::UserSettings settings;
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), log.GetByteLength());
+    ASSERT_EQ(dal_->Append(log), 2);
+}
+
+TEST_F(EmptyLogDalTest, Durability) {
+    Log log(Log::Command::PUT, {'a'}, std::vector<byte>(6, '#'));
+    dal_->sync_interval_ = std::chrono::hours(1);
+    // Asynchronous commit returns before its log is written
+    auto async = dal_->Append(log);
+    dal_->WaitDurable(async, settings::Durability::kAsync);
+    ASSERT_TRUE(dal_->syncer_.joinable());
+    ASSERT_LT(dal_->durable_sequence_, async);
+    ASSERT_TRUE(dal_->ReadLogBuffer().empty());
+    // Synchronous commit writes the logs before it
+    dal_->WaitDurable(dal_->Append(log), settings::Durability::kSync);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 2 * log.GetByteLength());
+    // Logs of asynchronous commits are written on close
+    dal_->WaitDurable(dal_->Append(log), settings::Durability::kAsync);
+    dal_->Close();
+
+    settings::UserSettings settings;
+    settings.durability = settings::Durability::kGroup;
+    settings.sync_interval_us = 1000;
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 3 * log.GetByteLength());
+    // Group commit waits for the periodic sync
+    auto group = dal_->Append(log);
+    dal_->WaitDurable(group);
+    ASSERT_GE(dal_->durable_sequence_, group);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 4 * log.GetByteLength());
+}
+
+TEST_F(EmptyLogDalTest, FramedRecovery) {
+    std::vector<byte> data(6);
+    std::memcpy(data.data(), "World", 6);
+    Log log(Log::Command::PUT, {'a'}, data);
+    for (int i = 0; i < 3; ++i) {
+        dal_->WriteLog(log);
+    }
+    // Appends don't rewrite meta
+    ASSERT_EQ(dal_->GetMetaPtr()->GetStartSequence(), 1);
+    dal_->Close();
+
+    // Corrupt the last record and add a torn one
+    {
+        std::fstream file("test.db.log.0", std::fstream::in | std::fstream::out);
+        uint64_t end = LogDAL::kSegmentHeaderSize + 3 * (LogDAL::kFrameHeaderSize + log.GetByteLength());
+        file.seekp(end - 1);
+        file.put('#');
+        file.write("\x10\x20\x30", 3);
+    }
+
+    settings::UserSettings settings;
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 2 * log.GetByteLength());
+    ASSERT_EQ(dal_->Append(log), 3);
+    dal_->WaitDurable(3);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 3 * log.GetByteLength());
+
+    // Truncation starts new sequence, old records are not valid anymore
+    dal_->ClearLogs();
+    ASSERT_EQ(dal_->GetMetaPtr()->GetStartSequence(), 4);
+    ASSERT_TRUE(dal_->ReadLogBuffer().empty());
+}
+
+TEST_F(EmptyLogDalTest, Segments) {
+    settings::UserSettings settings;
+    settings.log_segment_size = 256;
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+
+    Log log(Log::Command::PUT, {'a'}, std::vector<byte>(50, '#'));
+    for (int i = 0; i < 20; ++i) {
+        dal_->WriteLog(log);
+    }
+    // Records don't cross segments and appends don't extend files
+    size_t segments_count = 0;
+    while (std::filesystem::exists("test.db.log." + std::to_string(segments_count))) {
+        ASSERT_EQ(std::filesystem::file_size("test.db.log." + std::to_string(segments_count)), 256);
+        ++segments_count;
+    }
+    ASSERT_EQ(segments_count, 10);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 20 * log.GetByteLength());
+
+    // Cleared segments are renamed to follow the live ones and reused
+    dal_->ClearLogs();
+    for (int i = 0; i < 3; ++i) {
+        dal_->WriteLog(log);
+    }
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 3 * log.GetByteLength());
+    ASSERT_FALSE(std::filesystem::exists("test.db.log.9"));
+    ASSERT_TRUE(std::filesystem::exists("test.db.log.19"));
+    ASSERT_FALSE(std::filesystem::exists("test.db.log.20"));
+
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 3 * log.GetByteLength());
+    dal_->WriteLog(log);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 4 * log.GetByteLength());
+}
+
+TEST_F(EmptyLogDalTest, Rotate) {
+    settings::UserSettings settings;
+    settings.log_segment_size = 256;
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+
+    Log log(Log::Command::PUT, {'a'}, std::vector<byte>(50, '#'));
+    for (int i = 0; i < 5; ++i) {
+        dal_->WriteLog(log);
+    }
+    // Queued log is written before the checkpoint, later ones go after it
+    auto queued = dal_->Append(log);
+    auto checkpoint = dal_->Rotate();
+    ASSERT_EQ(checkpoint.sequence, queued + 1);
+    ASSERT_NO_THROW(dal_->WaitDurable(queued));
+    for (int i = 0; i < 2; ++i) {
+        dal_->WriteLog(log);
+    }
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 8 * log.GetByteLength());
+
+    // Only records after the checkpoint are left
+    dal_->Release(checkpoint);
+    ASSERT_EQ(dal_->GetMetaPtr()->GetFirstSegment(), checkpoint.segment);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 2 * log.GetByteLength());
+    ASSERT_FALSE(std::filesystem::exists("test.db.log.0"));
+
+    dal_ = std::make_shared<LogDAL>("test.db.log", settings);
+    ASSERT_EQ(dal_->ReadLogBuffer().size(), 2 * log.GetByteLength());
+    ASSERT_EQ(dal_->Append(log), checkpoint.sequence + 2);
+}
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <thread>
 
 #define private public
 #define protected public
@@ -57,6 +58,66 @@ TEST_F(EmptyLogStorageTest, Workflow) {
     }
 }
 
+TEST_F(EmptyLogStorageTest, FailedWrite) {
+    LogStorage log_storage(dal_, log_dal_, settings_);
+    log_dal_->Close();
+
+    // Record, that is not durable, is not visible
+    auto key = LogStorage::ConvertFromStr(std::string("Hello") + '\0');
+    ASSERT_THROW(log_storage.Put(key, key), dal_error::FileError);
+    ASSERT_FALSE(log_storage.Find(key).has_value());
+    ASSERT_EQ(log_storage.Size(), 0);
+}
+
+TEST_F(EmptyLogStorageTest, Replay) {
+    auto key = [](int i) { return LogStorage::ConvertFromStr("key" + std::to_string(i) + '\0'); };
+    std::vector<byte> value(500, 'v');
+    settings_.log_segment_size = 64 * 1024;
+    log_dal_ = std::make_shared<LogDAL>("log_storage_test.db.log", settings_);
+    {
+        LogStorage log_storage(dal_, log_dal_, settings_);
+        for (int i = 0; i < 1000; ++i) {
+            log_storage.Put(key(i), value);
+        }
+        log_storage.PushTransactionLogs({{Log::Command::PUT, key(1000), value}, {Log::Command::REMOVE, key(0)}});
+        // Transaction, that is torn by a crash
+        log_dal_->WaitDurable(log_dal_->AppendBatch({{Log::Command::PUT, key(1001), value},
+                                                     {Log::Command::REMOVE, key(1)}}));
+        LogDAL::Position torn{};
+        log_dal_->ScanFrames([&torn](uint64_t, uint32_t, const byte*, size_t, LogDAL::Position position) {
+            torn = position;
+        });
+        int fd = ::open(log_dal_->SegmentPath(torn.segment).c_str(), O_WRONLY);
+        byte lost = 0;
+        ASSERT_EQ(::pwrite(fd, &lost, 1, torn.offset + LogDAL::kFrameHeaderSize + 100), 1);
+        ::close(fd);
+    }
+    log_dal_.reset();
+    log_dal_ = std::make_shared<LogDAL>("log_storage_test.db.log", settings_);
+    uint64_t sequence = 0;
+    {
+        // Log spans several segments and is replayed one segment at a time
+        ASSERT_GT(log_dal_->segment_index_, 1);
+        LogStorage log_storage(dal_, log_dal_, settings_);
+        ASSERT_EQ(log_storage.Size(), 1002);
+        ASSERT_FALSE(log_storage.Find(key(0)).has_value());
+        ASSERT_EQ(log_storage.Find(key(1)), value);
+        ASSERT_EQ(log_storage.Find(key(1000)), value);
+        ASSERT_FALSE(log_storage.Find(key(1001)).has_value());
+        // Torn transaction is dropped from the log as a whole, so the next record takes its place
+        sequence = *log_storage.Put(key(1002), value);
+        ASSERT_EQ(sequence, log_dal_->GetMetaPtr()->GetStartSequence() + 1000 + 2);
+    }
+    log_dal_.reset();
+    log_dal_ = std::make_shared<LogDAL>("log_storage_test.db.log", settings_);
+    {
+        LogStorage log_storage(dal_, log_dal_, settings_);
+        ASSERT_EQ(log_storage.Find(key(1)), value);
+        ASSERT_FALSE(log_storage.Find(key(1001)).has_value());
+        ASSERT_EQ(log_storage.Find(key(1002)), value);
+    }
+}
+
 class LogStorageTest : public ::testing::Test {
 protected:
     settings::UserSettings settings_;
@@ -71,6 +132,8 @@ protected:
         if (std::filesystem::exists("log_storage_test.db.log")) {
             std::filesystem::remove("log_storage_test.db.log");
             std::filesystem::copy_file("../test/data/log_storage_test.db.log", "log_storage_test.db.log");
+            std::filesystem::remove("log_storage_test.db.log.0");
+            std::filesystem::copy_file("../test/data/log_storage_test.db.log.0", "log_storage_test.db.log.0");
         }
         dal_ = std::make_shared<DAL>("log_storage_test.db", settings_);
         log_dal_ = std::make_shared<LogDAL>("log_storage_test.db.log", settings_);
@@ -90,3 +153,68 @@ TEST_F(LogStorageTest, Workflow) {
         ASSERT_FALSE(log_storage.Find(key).has_value());
     }
 }
+
+TEST(MemTable, Order) {
+    MemTable table(comparator::GetFunction(comparator::Type::kBytewise, nullptr));
+    table.Add(1, Log::Command::PUT, "b", "1");
+    table.Add(2, Log::Command::PUT, "a", "2");
+    table.Add(3, Log::Command::REMOVE, "b", "");
+    table.Add(4, Log::Command::PUT, "c", "3");
+    ASSERT_EQ(table.Size(), 4);
+
+    ASSERT_EQ(table.Find("b")->sequence, 3);
+    ASSERT_EQ(table.Find("a")->value, "2");
+    ASSERT_FALSE(table.Find("ab").has_value());
+
+    // Keys ascending, records of the same key from the newest one
+    std::vector<uint64_t> sequences;
+    for (auto it = table.Begin(); it.Valid(); it.Next()) {
+        sequences.push_back(it.Get().sequence);
+    }
+    ASSERT_EQ(sequences, std::vector<uint64_t>({2, 3, 1, 4}));
+
+    std::string keys;
+    for (auto it = table.Begin(); it.Valid(); it.NextKey()) {
+        keys += it.Get().key;
+    }
+    ASSERT_EQ(keys, "abc");
+
+    // Records are counted in allocated bytes
+    auto usage = table.MemoryUsage();
+    table.Add(5, Log::Command::PUT, "d", std::string(100 * 1024, '#'));
+    ASSERT_GE(table.MemoryUsage(), usage + 100 * 1024);
+    ASSERT_EQ(table.Find("d")->value.size(), 100 * 1024);
+}
+
+TEST(MemTable, ConcurrentAdd) {
+    MemTable table(comparator::GetFunction(comparator::Type::kBytewise, nullptr));
+    std::atomic<uint64_t> sequence = 0;
+    std::vector<std::thread> threads;
+    for (int thread_index = 0; thread_index < 8; ++thread_index) {
+        threads.emplace_back([&table, &sequence]() {
+            for (int i = 0; i < 1000; ++i) {
+                auto key = std::to_string(i % 100);
+                table.Add(++sequence, Log::Command::PUT, key, key);
+                ASSERT_TRUE(table.Find(key).has_value());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(table.Size(), 8000);
+    size_t keys_count = 0;
+    std::optional<MemTable::Entry> previous;
+    for (auto it = table.Begin(); it.Valid(); it.Next()) {
+        auto entry = it.Get();
+        if (previous.has_value() && previous->key == entry.key) {
+            ASSERT_GT(previous->sequence, entry.sequence);
+        } else {
+            ASSERT_TRUE(!previous.has_value() || previous->key < entry.key);
+            ++keys_count;
+        }
+        previous = entry;
+    }
+    ASSERT_EQ(keys_count, 100);
+}
@@ -1,10 +1,51 @@
 #include <gtest/gtest.h>
 
+#include <future>
+
 #define private public
 #define protected public
 
+#include "dal/file.h"
 #include "storage/storage.h"
 
+namespace {
+
+// Removes files of the table, left by previous runs
+void RemoveTable(const std::string& path) {
+    for (const auto& file : {path, path + ".log", path + ".mlog", path + ".lsm", path + ".bloom"}) {
+        if (std::filesystem::exists(file)) {
+            std::filesystem::remove(file);
+        }
+    }
+    for (const auto& file : std::filesystem::directory_iterator(".")) {
+        auto name = file.path().filename().string();
+        if (name.starts_with(path + ".") && name.ends_with(".sst")) {
+            std::filesystem::remove(file.path());
+        }
+    }
+}
+
+std::vector<byte> Key(int index) {
+    return LogStorage::ConvertFromStr("key" + std::to_string(index) + '\0');
+}
+
+// Puts count keys directly into the tree, bypassing the memtable
+void FillTree(Storage& storage, int count, const std::vector<byte>& value,
+              const std::function<std::vector<byte>(int)>& key = Key) {
+    for (int i = 0; i < count; ++i) {
+        ASSERT_NO_THROW(storage.PutInTree(key(i), value));
+        storage.ClearState();
+    }
+}
+
+// Active memtable is switched by the flush thread, so it's read under the lock
+size_t MemTableUsage(Storage& storage) {
+    std::shared_lock lock(storage.mutex_);
+    return storage.log_storage_.MemoryUsage();
+}
+
+}  // namespace
+
 TEST(Storage, TreeWorkflow) {
     settings::UserSettings settings;
     Storage storage("storage_test.db", settings);
@@ -80,4 +121,632 @@ TEST(Storage, StorageRecovery) {
         ASSERT_TRUE(data_opt.has_value());
         ASSERT_EQ(*data_opt, data);
     }
-}
\ No newline at end of file
+}
+
+TEST(Storage, LazyRebalance) {
+    RemoveTable("lazy_storage_test.db");
+    settings::UserSettings settings;
+    settings.lazy_rebalance = true;
+    settings.max_deferred_rebalance = 1000;
+    Storage storage("lazy_storage_test.db", settings);
+
+    FillTree(storage, 300, std::vector<byte>(200, '#'));
+    for (int i = 0; i < 300; ++i) {
+        if (i % 10 == 0) {
+            continue;
+        }
+        ASSERT_NO_THROW(storage.RemoveInTree(Key(i)));
+        storage.ClearState();
+    }
+    ASSERT_FALSE(storage.deferred_rebalance_.empty());
+
+    ASSERT_NO_THROW(storage.RebalanceDeferred());
+    ASSERT_TRUE(storage.deferred_rebalance_.empty());
+    for (int i = 0; i < 300; ++i) {
+        auto result = storage.FindInTree(Key(i));
+        ASSERT_EQ(result.has_value(), i % 10 == 0);
+    }
+}
+
+TEST(Storage, CopyOnWrite) {
+    RemoveTable("cow_storage_test.db");
+    settings::UserSettings settings;
+    settings.copy_on_write = true;
+    {
+        Storage storage("cow_storage_test.db", settings);
+        // Undo log is not used at all
+        ASSERT_EQ(storage.memory_log_dal_, nullptr);
+        ASSERT_FALSE(std::filesystem::exists("cow_storage_test.db.mlog"));
+
+        std::vector<byte> data(200, '#');
+        for (int i = 0; i < 100; ++i) {
+            auto old_root = storage.root_;
+            ASSERT_NO_THROW(storage.PutInTree(Key(i), data));
+            // Every commit publishes a new tree version, nothing goes to undo log
+            ASSERT_NE(storage.root_, old_root);
+            ASSERT_EQ(storage.dal_->GetMetaPtr()->GetRootPage(), storage.root_);
+            storage.ClearState();
+        }
+        for (int i = 0; i < 100; i += 2) {
+            ASSERT_NO_THROW(storage.RemoveInTree(Key(i)));
+            storage.ClearState();
+        }
+    }
+    Storage storage("cow_storage_test.db", settings);
+    for (int i = 0; i < 100; ++i) {
+        auto result = storage.FindInTree(Key(i));
+        ASSERT_EQ(result.has_value(), i % 2 == 1);
+    }
+}
+
+TEST(Storage, FindKeyPath) {
+    RemoveTable("path_storage_test.db");
+    settings::UserSettings settings;
+    Storage storage("path_storage_test.db", settings);
+    FillTree(storage, 300, std::vector<byte>(200, '#'));
+    storage.Checkpoint();
+
+    size_t height = 1;
+    for (auto node = storage.GetNode(storage.root_); !node->IsLeaf();
+         node = storage.GetNode(node->ChildNodesPtr()->front())) {
+        ++height;
+    }
+    ASSERT_GT(height, 1);
+
+    auto key = LogStorage::ConvertFromStr("key150!");
+    auto reads = storage.dal_->GetReadCount();
+    auto [node, index, path] = storage.FindKey(key, false);
+    // Each node on the way is read and decoded once
+    ASSERT_EQ(storage.dal_->GetReadCount() - reads, height);
+    ASSERT_TRUE(node->IsLeaf());
+    ASSERT_EQ(path.size() + 1, height);
+    // Path is decoded once and links nodes by child indexes
+    ASSERT_EQ(std::get<0>(path.front())->GetPageNum(), storage.root_);
+    path.emplace_back(node, index);
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+        auto [parent, child_index] = path[i];
+        ASSERT_EQ(parent->ChildNodesPtr()->operator[](child_index), std::get<0>(path[i + 1])->GetPageNum());
+    }
+}
+
+TEST(Storage, Comparator) {
+    RemoveTable("comparator_storage_test.db");
+    settings::UserSettings settings;
+    settings.comparator = comparator::Type::kUInt64;
+    {
+        Storage storage("comparator_storage_test.db", settings);
+        FillTree(storage, 300, std::vector<byte>(100, '#'), [](int i) {
+            std::vector<byte> key(8);
+            memory::uint64_to_bytes(key.data(), (i * 7919) % 300);
+            return key;
+        });
+
+        // In-order traversal returns keys in numeric order
+        std::vector<uint64_t> keys;
+        std::function<void(uint64_t)> traverse = [&](uint64_t page_num) {
+            auto node = storage.GetNode(page_num);
+            auto& items = *node->ItemsPtr();
+            for (size_t i = 0; i < items.size(); ++i) {
+                if (!node->IsLeaf()) {
+                    traverse(node->ChildNodesPtr()->operator[](i));
+                }
+                keys.push_back(memory::bytes_to_uint64(items[i]->KeyData()));
+            }
+            if (!node->IsLeaf()) {
+                traverse(node->ChildNodesPtr()->back());
+            }
+        };
+        traverse(storage.root_);
+        ASSERT_EQ(keys.size(), 300);
+        for (uint64_t i = 0; i < keys.size(); ++i) {
+            ASSERT_EQ(keys[i], i);
+        }
+    }
+
+    // Order is recorded in meta
+    settings.comparator = comparator::Type::kBytewise;
+    ASSERT_THROW(Storage("comparator_storage_test.db", settings), storage_error::SettingsMismatch);
+}
+
+TEST(Storage, CustomComparatorName) {
+    RemoveTable("custom_comparator_storage_test.db");
+    settings::UserSettings settings;
+    settings.comparator = comparator::Type::kCustom;
+    settings.custom_comparator = [](const byte* lhs, size_t lhs_size, const byte* rhs, size_t rhs_size) {
+        return comparator::ReverseBytewise()(lhs, lhs_size, rhs, rhs_size);
+    };
+    ASSERT_THROW(Storage("custom_comparator_storage_test.db", settings), storage_error::SettingsMismatch);
+
+    settings.custom_comparator_name = "reverse";
+    {
+        Storage storage("custom_comparator_storage_test.db", settings);
+        FillTree(storage, 10, std::vector<byte>(100, '#'));
+    }
+    ASSERT_NO_THROW(Storage("custom_comparator_storage_test.db", settings));
+
+    // Function can't be compared, so the name identifies it
+    settings.custom_comparator_name = "other";
+    ASSERT_THROW(Storage("custom_comparator_storage_test.db", settings), storage_error::SettingsMismatch);
+}
+
+TEST(Storage, UInt64Keys) {
+    RemoveTable("uint64_storage_test.db");
+    settings::UserSettings settings;
+    settings.uint64_keys = true;
+    {
+        Storage storage("uint64_storage_test.db", settings);
+        FillTree(storage, 300, std::vector<byte>(100, '#'), [](int i) {
+            std::vector<byte> key(8);
+            memory::uint64_to_bytes(key.data(), ((i * 7919) % 300) * 1000);
+            return key;
+        });
+        ASSERT_FALSE(storage.GetNode(storage.root_)->IsLeaf());
+
+        for (uint64_t i = 0; i < 300 * 1000; i += 500) {
+            std::vector<byte> key(8);
+            memory::uint64_to_bytes(key.data(), i);
+            auto result = storage.Find(key);
+            ASSERT_EQ(result.has_value(), i % 1000 == 0);
+        }
+        ASSERT_THROW(storage.Find(LogStorage::ConvertFromStr("key")), storage_error::InvalidKey);
+    }
+
+    // Packed keys are read back from disk
+    settings.uint64_keys = false;
+    ASSERT_THROW(Storage("uint64_storage_test.db", settings), storage_error::SettingsMismatch);
+    settings.uint64_keys = true;
+    Storage storage("uint64_storage_test.db", settings);
+    ASSERT_FALSE(storage.GetNode(storage.root_)->PackedKeys().empty());
+    std::vector<byte> key(8);
+    memory::uint64_to_bytes(key.data(), 299 * 1000);
+    ASSERT_TRUE(storage.Find(key).has_value());
+}
+
+TEST(Storage, InterpolationSearch) {
+    std::vector<uint64_t> keys = {1, 2, 3, 100, 1000, 1001, 1 << 20, UINT64_MAX};
+    for (uint64_t key : std::vector<uint64_t>{0, 1, 3, 4, 999, 1001, 1 << 20, (1 << 20) + 1, UINT64_MAX}) {
+        ASSERT_EQ(Storage::InterpolationSearch(keys, key),
+                  std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+    }
+    ASSERT_EQ(Storage::InterpolationSearch({}, 5), 0);
+}
+
+TEST(Storage, MemTableOverTree) {
+    RemoveTable("memtable_storage_test.db");
+    settings::UserSettings settings;
+    {
+        Storage storage("memtable_storage_test.db", settings);
+        auto key = LogStorage::ConvertFromStr(std::string("key") + '\0');
+        storage.PutInTree(key, LogStorage::ConvertFromStr("tree" + std::string(1, '\0')));
+        storage.ClearState();
+
+        // Removal in memtable hides the tree value
+        storage.Remove(key);
+        ASSERT_FALSE(storage.Find(key).has_value());
+
+        // Only the newest record is pushed to the tree
+        storage.Put(key, LogStorage::ConvertFromStr("first" + std::string(1, '\0')));
+        storage.Put(key, LogStorage::ConvertFromStr("second" + std::string(1, '\0')));
+        storage.PushLog();
+        ASSERT_EQ(storage.log_storage_.Size(), 0);
+        ASSERT_EQ(storage.FindInTree(key), LogStorage::ConvertFromStr("second" + std::string(1, '\0')));
+    }
+}
+
+TEST(Storage, MemTableLimit) {
+    RemoveTable("limit_storage_test.db");
+    settings::UserSettings settings;
+    settings.memtable_soft_limit = 1;
+    settings.memtable_hard_limit = 1;
+    {
+        // Limits are at least one arena block
+        Storage storage("limit_storage_test.db", settings);
+        ASSERT_EQ(storage.settings_.memtable_soft_limit, Arena::kDefaultBlockSize);
+        ASSERT_EQ(storage.settings_.memtable_hard_limit, Arena::kDefaultBlockSize);
+    }
+
+    RemoveTable("limit_storage_test.db");
+    settings.memtable_soft_limit = 128 * 1024;
+    settings.memtable_hard_limit = 256 * 1024;
+    {
+        Storage storage("limit_storage_test.db", settings);
+        ASSERT_LT(MemTableUsage(storage), settings.memtable_soft_limit);
+
+        // Records take more than the hard limit, but fit the tree file
+        std::vector<byte> value(512, 'v');
+        size_t max_usage = 0;
+        for (int i = 0; i < 600; ++i) {
+            storage.Put(Key(i), value);
+            // Memtable is bounded by bytes, the last record may exceed the hard limit
+            auto usage = MemTableUsage(storage);
+            ASSERT_LT(usage, settings.memtable_hard_limit + 2 * value.size());
+            max_usage = std::max(max_usage, usage);
+        }
+        // Memtable has grown up to the soft limit and was flushed. Record, that reaches the limit,
+        // freezes the memtable, so the largest seen usage is below the limit by at most one record
+        ASSERT_GE(max_usage + 2 * value.size(), settings.memtable_soft_limit);
+        {
+            std::shared_lock tree_lock(storage.tree_mutex_);
+            ASSERT_NE(storage.root_, 0);
+        }
+        for (int i = 0; i < 600; ++i) {
+            ASSERT_EQ(storage.Find(Key(i)), value);
+        }
+    }
+}
+
+TEST(Storage, BackgroundFlush) {
+    RemoveTable("flush_storage_test.db");
+    settings::UserSettings settings;
+    settings.memtable_soft_limit = 64 * 1024;
+    settings.memtable_hard_limit = 128 * 1024;
+    {
+        Storage storage("flush_storage_test.db", settings);
+        std::vector<byte> value(512, 'v');
+        for (int i = 0; i < 300; ++i) {
+            storage.Put(Key(i), value);
+            ASSERT_LT(MemTableUsage(storage), settings.memtable_hard_limit + 2 * value.size());
+        }
+        // Full memtable is merged by the flush thread, while writes go to a fresh one
+        {
+            std::unique_lock lock(storage.mutex_);
+            storage.WaitFlush(lock);
+            ASSERT_EQ(storage.log_storage_.GetImmutable(), nullptr);
+        }
+        ASSERT_EQ(storage.FindInTree(Key(0)), value);
+        for (int i = 0; i < 300; ++i) {
+            ASSERT_EQ(storage.Find(Key(i)), value);
+        }
+
+        // Logs of merged memtables are released
+        storage.PushLog();
+        ASSERT_EQ(storage.log_storage_.Size(), 0);
+        ASSERT_TRUE(storage.log_dal_->ReadLogBuffer().empty());
+        ASSERT_EQ(storage.FindInTree(Key(299)), value);
+    }
+}
+
+TEST(Storage, Lsm) {
+    RemoveTable("lsm_storage_test.db");
+    settings::UserSettings settings;
+    settings.engine = settings::Engine::kLsm;
+    settings.memtable_soft_limit = 64 * 1024;
+    settings.memtable_hard_limit = 128 * 1024;
+    settings.lsm_level0_runs = 2;
+    settings.lsm_level_size = 256 * 1024;
+    std::vector<byte> value(512, 'v');
+    std::vector<byte> new_value(512, 'n');
+    {
+        Storage storage("lsm_storage_test.db", settings);
+        for (int i = 0; i < 1000; ++i) {
+            storage.Put(Key(i), value);
+        }
+        // Older runs are overwritten and removed from by the newer ones
+        for (int i = 0; i < 1000; i += 2) {
+            storage.Put(Key(i), new_value);
+        }
+        for (int i = 0; i < 1000; i += 3) {
+            storage.Remove(Key(i));
+        }
+        storage.PushLog();
+        ASSERT_EQ(storage.root_, 0);
+        // Level 0 is compacted, once it has lsm_level0_runs runs
+        auto levels = storage.lsm_->LevelSizes();
+        ASSERT_GE(levels.size(), 2);
+        ASSERT_LT(levels[0], settings.lsm_level0_runs);
+    }
+    {
+        Storage storage("lsm_storage_test.db", settings);
+        for (int i = 0; i < 1000; ++i) {
+            if (i % 3 == 0) {
+                ASSERT_EQ(storage.Find(Key(i)), std::nullopt);
+            } else {
+                ASSERT_EQ(storage.Find(Key(i)), i % 2 == 0 ? new_value : value);
+            }
+        }
+        ASSERT_EQ(storage.Find(Key(1000)), std::nullopt);
+    }
+    // Engine is fixed on creation
+    settings.engine = settings::Engine::kBTree;
+    ASSERT_THROW(Storage("lsm_storage_test.db", settings), storage_error::SettingsMismatch);
+}
+
+TEST(Storage, TreeFilter) {
+    RemoveTable("filter_storage_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    auto absent = [](int i) { return LogStorage::ConvertFromStr("absent" + std::to_string(i) + '\0'); };
+    auto false_positives = [&absent](Storage& storage) {
+        std::shared_lock lock(storage.tree_mutex_);
+        int count = 0;
+        for (int i = 0; i < 1000; ++i) {
+            count += storage.MayContain(absent(i));
+        }
+        return count;
+    };
+    {
+        Storage storage("filter_storage_test.db", settings);
+        // Filter grows with the tree
+        FillTree(storage, 3000, value);
+        ASSERT_GE(storage.filter_capacity_, 3000);
+        for (int i = 0; i < 3000; ++i) {
+            ASSERT_TRUE(storage.MayContain(Key(i)));
+        }
+        ASSERT_LT(false_positives(storage), 50);
+        ASSERT_EQ(storage.Find(absent(0)), std::nullopt);
+    }
+    // Filter is saved on close and taken back on open
+    ASSERT_TRUE(std::filesystem::exists("filter_storage_test.db.bloom"));
+    {
+        Storage storage("filter_storage_test.db", settings);
+        ASSERT_FALSE(std::filesystem::exists("filter_storage_test.db.bloom"));
+        ASSERT_EQ(storage.filter_keys_, 3000);
+        ASSERT_LT(false_positives(storage), 50);
+        ASSERT_EQ(storage.Find(Key(2999)), value);
+    }
+    // Missing filter, as after a crash, is rebuilt from the tree
+    std::filesystem::remove("filter_storage_test.db.bloom");
+    {
+        Storage storage("filter_storage_test.db", settings);
+        for (int i = 0; i < 3000; ++i) {
+            ASSERT_TRUE(storage.MayContain(Key(i)));
+        }
+        ASSERT_LT(false_positives(storage), 50);
+    }
+}
+
+TEST(Storage, UndoJournal) {
+    RemoveTable("journal_storage_test.db");
+    RemoveTable("journal_crash_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    {
+        Storage storage("journal_storage_test.db", settings);
+        FillTree(storage, 500, value);
+    }
+    {
+        Storage storage("journal_storage_test.db", settings);
+        std::unique_lock tree_lock(storage.tree_mutex_);
+        for (int i = 1000; i < 1100; ++i) {
+            storage.PutInTree(Key(i), value);
+            storage.ClearState();
+        }
+        storage.dal_->WriteMeta();
+        auto pages = storage.dal_->GetDirtyPages();
+        ASSERT_GT(pages.size(), 1);
+        auto writes = storage.JournalCheckpoint(pages);
+        ASSERT_TRUE(storage.memory_log_dal_->IsCommitted());
+
+        // Crash after the journal commit, when only one page is written in place
+        for (auto [offset, size] : writes[0]) {
+            storage.dal_->WritePageRange(pages[0]->GetPageNum(), offset, pages[0]->Data() + offset, size);
+        }
+        storage.dal_->Sync();
+        std::filesystem::copy_file("journal_storage_test.db", "journal_crash_test.db");
+        std::filesystem::copy_file("journal_storage_test.db.mlog", "journal_crash_test.db.mlog");
+
+        storage.WriteCheckpoint(pages, writes);
+        ASSERT_EQ(std::filesystem::file_size("journal_storage_test.db.mlog"), 0);
+    }
+    {
+        // Interrupted checkpoint is undone on open
+        Storage storage("journal_crash_test.db", settings);
+        ASSERT_FALSE(storage.memory_log_dal_->IsCommitted());
+        ASSERT_EQ(storage.Find(Key(1050)), std::nullopt);
+        for (int i = 0; i < 500; ++i) {
+            ASSERT_EQ(storage.Find(Key(i)), value);
+        }
+    }
+    {
+        Storage storage("journal_storage_test.db", settings);
+        for (int i = 1000; i < 1100; ++i) {
+            ASSERT_EQ(storage.FindInTree(Key(i)), value);
+        }
+    }
+}
+
+TEST(Storage, DeltaJournal) {
+    RemoveTable("delta_storage_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    std::vector<byte> new_value(64, 'n');
+    {
+        Storage storage("delta_storage_test.db", settings);
+        FillTree(storage, 500, value);
+    }
+    {
+        Storage storage("delta_storage_test.db", settings);
+        std::unique_lock tree_lock(storage.tree_mutex_);
+        storage.PutInTreeImpl(Key(250), new_value);
+        storage.ClearState();
+        auto pages = storage.dal_->GetDirtyPages();
+        auto writes = storage.JournalCheckpoint(pages);
+        // Only the changed value bytes are journaled, not the whole leaf page
+        ASSERT_LT(std::filesystem::file_size("delta_storage_test.db.mlog"), 256);
+        ASSERT_EQ(storage.memory_log_dal_->GetSavedPages().size(), 0);
+        ASSERT_FALSE(storage.memory_log_dal_->GetSavedRanges().empty());
+        storage.WriteCheckpoint(pages, writes);
+    }
+    {
+        Storage storage("delta_storage_test.db", settings);
+        ASSERT_EQ(storage.FindInTree(Key(250)), new_value);
+        ASSERT_EQ(storage.FindInTree(Key(251)), value);
+    }
+}
+
+TEST(Storage, WriteBack) {
+    RemoveTable("write_back_storage_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    Storage storage("write_back_storage_test.db", settings);
+    auto stored = file::ReadFile("write_back_storage_test.db");
+
+    // Tree operations only buffer pages, the file and the journal are untouched
+    FillTree(storage, 300, value);
+    ASSERT_GT(storage.dal_->GetDirtyPageCount(), 0);
+    ASSERT_EQ(file::ReadFile("write_back_storage_test.db"), stored);
+    ASSERT_EQ(std::filesystem::file_size("write_back_storage_test.db.mlog"), 0);
+    ASSERT_EQ(storage.FindInTree(Key(150)), value);
+
+    storage.Checkpoint();
+    ASSERT_EQ(storage.dal_->GetDirtyPageCount(), 0);
+    ASSERT_EQ(std::filesystem::file_size("write_back_storage_test.db.mlog"), 0);
+    // Checkpointed file is complete without close
+    std::filesystem::copy_file("write_back_storage_test.db", "write_back_copy_test.db",
+                               std::filesystem::copy_options::overwrite_existing);
+    {
+        DAL dal("write_back_copy_test.db", settings);
+        ASSERT_EQ(dal.GetMetaPtr()->GetRootPage(), storage.root_);
+    }
+    std::filesystem::remove("write_back_copy_test.db");
+}
+
+TEST(Storage, ReadsWithoutJournal) {
+    RemoveTable("read_storage_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    Storage storage("read_storage_test.db", settings);
+    FillTree(storage, 100, value);
+    storage.Checkpoint();
+
+    // Any I/O to the closed journal would throw
+    storage.memory_log_dal_->Close();
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_EQ(storage.Find(Key(i)), i < 100 ? std::make_optional(value) : std::nullopt);
+        ASSERT_EQ(storage.FindInTree(Key(i)), i < 100 ? std::make_optional(value) : std::nullopt);
+    }
+    ASSERT_FALSE(storage.save_started_);
+}
+
+TEST(Storage, OptimisticReads) {
+    for (bool copy_on_write : {false, true}) {
+        RemoveTable("optimistic_storage_test.db");
+        settings::UserSettings settings;
+        settings.copy_on_write = copy_on_write;
+        std::vector<byte> value(64, 'v');
+        Storage storage("optimistic_storage_test.db", settings);
+        FillTree(storage, 1000, value);
+
+        // Lookup doesn't wait for a writer, that holds the tree
+        std::future<std::optional<std::vector<byte>>> reader;
+        {
+            std::unique_lock tree_lock(storage.tree_mutex_);
+            reader = std::async(std::launch::async, [&storage]() { return storage.Find(Key(500)); });
+            ASSERT_EQ(reader.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+        }
+        ASSERT_EQ(reader.get(), value);
+
+        // Splits and merges of the writer never hide keys from readers
+        std::atomic<bool> stop = false;
+        std::atomic<int> misses = 0;
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&, t]() {
+                for (int i = t; !stop; i = (i + 7) % 1000) {
+                    misses += storage.Find(Key(i)) != value;
+                }
+            });
+        }
+        for (int i = 1000; i < 3000; ++i) {
+            storage.PutInTree(Key(i), value);
+            storage.ClearState();
+        }
+        for (int i = 1000; i < 3000; ++i) {
+            storage.RemoveInTree(Key(i));
+            storage.ClearState();
+        }
+        stop = true;
+        for (auto& thread : readers) {
+            thread.join();
+        }
+        ASSERT_EQ(misses, 0);
+    }
+}
+
+TEST(Storage, SnapshotReads) {
+    for (auto engine : {settings::Engine::kBTree, settings::Engine::kLsm}) {
+        RemoveTable("snapshot_storage_test.db");
+        settings::UserSettings settings;
+        settings.engine = engine;
+        std::vector<byte> value(64, 'v');
+        std::vector<byte> new_value(64, 'n');
+        Storage storage("snapshot_storage_test.db", settings);
+        storage.Put(Key(0), value);
+        storage.Put(Key(1), value);
+        storage.PushLog();
+        storage.Put(Key(2), value);
+
+        auto snapshot = storage.GetSnapshot();
+        storage.Put(Key(0), new_value);
+        storage.Remove(Key(1));
+        storage.Put(Key(2), new_value);
+        storage.Put(Key(3), value);
+        ASSERT_EQ(storage.Find(Key(0), *snapshot), value);
+        ASSERT_EQ(storage.Find(Key(1), *snapshot), value);
+        ASSERT_EQ(storage.Find(Key(3), *snapshot), std::nullopt);
+        ASSERT_EQ(storage.Find(Key(0)), new_value);
+
+        // Merged memtable keeps the values, the snapshot sees
+        storage.PushLog();
+        ASSERT_EQ(storage.merged_versions_.size(), 1);
+        ASSERT_EQ(storage.Find(Key(0), *snapshot), value);
+        ASSERT_EQ(storage.Find(Key(1), *snapshot), value);
+        ASSERT_EQ(storage.Find(Key(2), *snapshot), value);
+        ASSERT_EQ(storage.Find(Key(3), *snapshot), std::nullopt);
+        ASSERT_EQ(storage.Find(Key(1)), std::nullopt);
+        ASSERT_EQ(storage.Find(Key(2)), new_value);
+
+        // Versions are dropped with the last snapshot, that needs them
+        auto latest = storage.GetSnapshot();
+        ASSERT_EQ(storage.Find(Key(0), *latest), new_value);
+        snapshot.reset();
+        ASSERT_TRUE(storage.merged_versions_.empty());
+        latest.reset();
+    }
+}
+
+TEST(Storage, SnapshotReadDuringCommit) {
+    RemoveTable("commit_storage_test.db");
+    settings::UserSettings settings;
+    std::vector<byte> value(64, 'v');
+    std::vector<byte> new_value(64, 'n');
+    Storage storage("commit_storage_test.db", settings);
+    storage.Put(Key(0), value);
+
+    // Leader slot is taken, so the commit is parked in WaitDurable
+    auto& log_dal = *storage.log_dal_;
+    auto appended = [&log_dal]() {
+        std::unique_lock lock(log_dal.queue_mutex_);
+        return log_dal.appended_sequence_;
+    };
+    {
+        std::unique_lock lock(log_dal.queue_mutex_);
+        log_dal.leader_active_ = true;
+    }
+    auto sequence = appended();
+    auto commit = std::async(std::launch::async, [&storage, &new_value]() {
+        storage.PushTransactionLogs({Log(Log::Command::PUT, Key(0), new_value)}, settings::Durability::kSync);
+    });
+    while (appended() == sequence) {
+        std::this_thread::yield();
+    }
+
+    // Snapshot read doesn't wait for the log sync
+    auto read = std::async(std::launch::async, [&storage]() {
+        auto snapshot = storage.GetSnapshot();
+        return storage.Find(Key(0), *snapshot);
+    });
+    bool read_finished = read.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+    bool commit_parked = commit.wait_for(std::chrono::seconds(0)) == std::future_status::timeout;
+
+    {
+        std::unique_lock lock(log_dal.queue_mutex_);
+        log_dal.leader_active_ = false;
+        log_dal.durable_cv_.notify_all();
+    }
+    commit.get();
+    ASSERT_TRUE(read_finished);
+    ASSERT_TRUE(commit_parked);
+    ASSERT_EQ(read.get(), value);
+    ASSERT_EQ(storage.Find(Key(0)), new_value);
+}